@@ -0,0 +1,166 @@
+#pragma once
+
+#ifdef USE_CRYPTOMINISAT5
+#include <cryptominisat5/cryptominisat.h>
+#endif
+
+#include <sat_modeller.h>
+#include <simplifier.h>
+
+#include <optional>
+#include <ranges>
+#include <span>
+#include <vector>
+
+namespace bonc {
+
+enum class SolvedModelValue {
+  Undefined = CMSat::l_Undef.getValue(),
+  True = CMSat::l_True.getValue(),
+  False = CMSat::l_False.getValue(),
+};
+
+inline std::ostream& operator<<(std::ostream& os, SolvedModelValue val) {
+  if (val == SolvedModelValue::True) {
+    os << "1";
+  } else if (val == SolvedModelValue::False) {
+    os << "0";
+  } else {
+    os << "x";
+  }
+  return os;
+}
+
+/**
+ * @brief Values of the original variables from a solution of `simplified`;
+ * unconstrained ones are left undefined.
+ */
+inline std::vector<SolvedModelValue> expand(
+    const bonc::sat_modeller::SimplifiedCNF& simplified,
+    const std::vector<SolvedModelValue>& values) {
+  using bonc::sat_modeller::SimplifiedCNF;
+  std::vector<SolvedModelValue> expanded(simplified.mapping.size(),
+                                         SolvedModelValue::Undefined);
+  for (auto var = 1uz; var < simplified.mapping.size(); var++) {
+    auto image = simplified.mapping[var];
+    if (image == SimplifiedCNF::FIXED_TRUE) {
+      expanded[var] = SolvedModelValue::True;
+    } else if (image == -SimplifiedCNF::FIXED_TRUE) {
+      expanded[var] = SolvedModelValue::False;
+    } else if (image != 0) {
+      auto value = values.at(std::abs(image));
+      if (image < 0 && value != SolvedModelValue::Undefined) {
+        value = value == SolvedModelValue::True ? SolvedModelValue::False
+                                                : SolvedModelValue::True;
+      }
+      expanded[var] = value;
+    }
+  }
+  return expanded;
+}
+
+#ifdef USE_CRYPTOMINISAT5
+
+/**
+ * @brief Clause sink that hands clauses to CryptoMiniSat as they are
+ * produced, growing the solver's variable set on demand. XOR constraints go
+ * to its native Gauss-Jordan engine.
+ */
+class CMSatClauseSink : public bonc::sat_modeller::ClauseSink {
+private:
+  CMSat::SATSolver& solver;
+  std::vector<CMSat::Lit> buffer;
+  std::vector<uint32_t> xor_buffer;
+
+  void reserveVariables(std::size_t count) {
+    if (count > solver.nVars()) {
+      solver.new_vars(count - solver.nVars());
+    }
+  }
+
+public:
+  explicit CMSatClauseSink(CMSat::SATSolver& solver) : solver{solver} {}
+
+  void addClause(ClauseView clause) override {
+    buffer.clear();
+    for (auto lit : clause) {
+      auto var = static_cast<uint32_t>(std::abs(lit));
+      reserveVariables(var + 1);
+      buffer.push_back(CMSat::Lit{var, lit < 0});
+    }
+    solver.add_clause(buffer);
+  }
+  void addXor(bonc::sat_modeller::XorArena::VariablesView variables,
+              bool rhs) override {
+    xor_buffer.clear();
+    for (auto var : variables) {
+      reserveVariables(var + 1);
+      xor_buffer.push_back(static_cast<uint32_t>(var));
+    }
+    solver.add_xor_clause(xor_buffer, rhs);
+  }
+  void finish(std::size_t variable_count, std::size_t) override {
+    // index 0 is reserved, keep it so solution indices match variables
+    reserveVariables(variable_count + 1);
+  }
+};
+
+/**
+ * @brief Solve under `assumptions`; learnt clauses are kept in `solver` for
+ * later calls.
+ */
+inline std::optional<std::vector<SolvedModelValue>> solve(
+    CMSat::SATSolver& solver,
+    std::span<const bonc::sat_modeller::Literal> assumptions = {}) {
+  std::vector<CMSat::Lit> lits;
+  lits.reserve(assumptions.size());
+  for (auto lit : assumptions) {
+    auto index = lit.getIndex();
+    lits.push_back(CMSat::Lit{static_cast<uint32_t>(std::abs(index)),
+                              lit.negative()});
+  }
+  auto ret = solver.solve(&lits);
+  if (ret == CMSat::l_True) {
+    return solver.get_model() | std::views::transform([](auto lit) {
+             return static_cast<SolvedModelValue>(lit.getValue());
+           })
+         | std::ranges::to<std::vector>();
+  } else {
+    return std::nullopt;
+  }
+}
+
+/**
+ * @brief Add stored clauses and XOR constraints to `solver`.
+ */
+inline void load(CMSat::SATSolver& solver,
+                 const bonc::sat_modeller::ClauseArena& clauses,
+                 const bonc::sat_modeller::XorArena& xors,
+                 std::size_t variable_count) {
+  CMSatClauseSink sink{solver};
+  for (auto clause : clauses) {
+    sink.addClause(clause);
+  }
+  for (auto i = 0uz; i < xors.size(); i++) {
+    sink.addXor(xors[i].variables, xors[i].rhs);
+  }
+  sink.finish(variable_count, clauses.size() + xors.size());
+}
+
+inline std::optional<std::vector<SolvedModelValue>> solve(
+    const bonc::sat_modeller::SATModel& model) {
+  CMSat::SATSolver solver;
+  load(solver, model.getClauses(), model.getXors(), model.variableSize() - 1);
+  return solve(solver);
+}
+
+#else
+
+inline std::optional<std::vector<SolvedModelValue>> solve(
+    const bonc::sat_modeller::SATModel& model) {
+  throw new std::runtime_error("cryptominisat5 is not enabled");
+}
+
+#endif
+
+}  // namespace bonc
@@ -1,8 +1,15 @@
 #pragma once
 
-#include <memory>
-#include <string>
-#include <variant>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <print>
+#include <span>
+#include <stdexcept>
 #include <vector>
 
 namespace bonc {
@@ -16,29 +23,46 @@ public:
   Type type{Unspecified};
 };
 
-class ModelVar {
-public:
-  std::string name;
+/**
+ * @brief Id of a model variable, dense from 0 in creation order.
+ */
+struct ModelVar {
+  std::uint32_t id;
+
+  friend bool operator==(ModelVar, ModelVar) = default;
 };
 
-class DeferredModelVar {
-private:
-  const ModelVar* var;
+/**
+ * @brief Id of a deferred variable: a slot of the model standing for some
+ * `ModelVar`, which can be rebound until the model is complete.
+ */
+struct DeferredModelVar {
+  std::uint32_t id;
 
-public:
-  DeferredModelVar(const ModelVar* var) : var{var} {}
+  friend bool operator==(DeferredModelVar, DeferredModelVar) = default;
+};
+
+using ModelledValue = ModelVar;
+using DeferredModelledValue = DeferredModelVar;
+using ConstDeferredModelledValue = DeferredModelVar;
 
-  const ModelVar* getVar() const {
-    return var;
+}  // namespace bonc
+
+template <>
+struct std::hash<bonc::ModelVar> {
+  std::size_t operator()(bonc::ModelVar var) const noexcept {
+    return var.id;
   }
-  void setVar(const ModelVar* newVar) {
-    var = newVar;
+};
+
+template <>
+struct std::hash<bonc::DeferredModelVar> {
+  std::size_t operator()(bonc::DeferredModelVar var) const noexcept {
+    return var.id;
   }
 };
 
-using ModelledValue = const ModelVar*;
-using DeferredModelledValue = DeferredModelVar*;
-using ConstDeferredModelledValue = const DeferredModelVar*;
+namespace bonc {
 
 template <typename T>
 struct LinearExprItem {
@@ -130,37 +154,130 @@ LinearConstraint<T> LinearExpr<T>::operator>=(double rhs) {
   return LinearConstraint<T>{*this, Comparator::GreaterEqual, rhs};
 }
 
-struct MaterializedResult {
-  std::unordered_map<const ModelVar*, std::string> variableNames;
-  std::string lpContent;
+/**
+ * @brief Constraints in compressed sparse row form: row `i` holds the
+ * entries `starts[i]` to `starts[i + 1]` of `columns` and `coefficients`,
+ * with the constant moved into its right hand side.
+ */
+struct LinearRows {
+  std::vector<std::size_t> starts{0};
+  std::vector<std::uint32_t> columns;
+  std::vector<double> coefficients;
+  std::vector<Comparator> comparators;
+  std::vector<double> rhs;
+
+  struct Row {
+    std::span<const std::uint32_t> columns;
+    std::span<const double> coefficients;
+    Comparator comparator;
+    double rhs;
+  };
+
+  std::size_t size() const {
+    return comparators.size();
+  }
+  Row operator[](std::size_t row) const {
+    auto first = starts[row], count = starts[row + 1] - first;
+    return {std::span{columns}.subspan(first, count),
+            std::span{coefficients}.subspan(first, count), comparators[row],
+            rhs[row]};
+  }
+
+  /**
+   * @brief Add an entry to the row being built.
+   */
+  void push(std::uint32_t column, double coefficient) {
+    columns.push_back(column);
+    coefficients.push_back(coefficient);
+  }
+  /**
+   * @brief End the row being built with the entries pushed since the last.
+   */
+  void close(Comparator comparator, double bound) {
+    starts.push_back(columns.size());
+    comparators.push_back(comparator);
+    rhs.push_back(bound);
+  }
+
+  std::size_t memoryUsage() const {
+    return starts.capacity() * sizeof(std::size_t)
+         + columns.capacity() * sizeof(std::uint32_t)
+         + coefficients.capacity() * sizeof(double)
+         + comparators.capacity() * sizeof(Comparator)
+         + rhs.capacity() * sizeof(double);
+  }
+};
+
+/**
+ * @brief Objective of a complete model, over the same columns as its rows.
+ */
+struct LinearObjective {
+  std::vector<std::uint32_t> columns;
+  std::vector<double> coefficients;
+  double constant{0.0};
+  bool maximize{};
 };
 
+/**
+ * @brief A 0/1 model built from variables that can be rebound.
+ *
+ * Variables are ids only, and deferred variables ids into a table of the
+ * variable each currently stands for. Constraints go into `LinearRows`
+ * right away, those over deferred variables in rows of their own, which
+ * `complete` resolves through that table once nothing is rebound anymore.
+ */
 class DeferredMILPModel {
 private:
-  std::vector<std::unique_ptr<ModelVar>> variables;
-  std::vector<std::unique_ptr<DeferredModelVar>> deferred_values;
-  std::vector<LinearConstraint<ModelledValue>> constraints;
-  std::vector<LinearConstraint<DeferredModelledValue>> deferred_constraints;
+  static constexpr std::uint32_t NO_COLUMN =
+      std::numeric_limits<std::uint32_t>::max();
+
+  std::size_t variable_count{0};
+  // deferred id -> the variable it stands for
+  std::vector<std::uint32_t> deferred_targets;
+  // over variable ids, or columns once presolved
+  LinearRows rows;
+  // over deferred ids, until `complete`
+  LinearRows deferred_rows;
 
   const bool allVariablesBinary{true};
 
   std::optional<Objective<DeferredModelledValue>> objective;
+  std::optional<LinearObjective> linear_objective;
+  bool completed{false};
+
+  // variable id -> column, or NO_COLUMN if `presolve` removed it; empty
+  // while they are the same
+  std::vector<std::uint32_t> columns_of;
+  std::size_t column_count{0};
+
+  template <typename T>
+  static void addRow(LinearRows& rows, const LinearConstraint<T>& constr) {
+    auto& [lhs, comparator, rhs] = constr;
+    for (auto& [var, coeff] : lhs.getItems()) {
+      rows.push(var.id, coeff);
+    }
+    rows.close(comparator, rhs - lhs.getConstant());
+  }
+
+  void requireComplete() const {
+    if (!completed) {
+      throw std::runtime_error("The MILP model is not complete");
+    }
+  }
 
 public:
-  ModelledValue createVariable(const std::string& name = "") {
-    auto ptr = std::make_unique<ModelVar>(ModelVar{name});
-    auto result = ptr.get();
-    variables.push_back(std::move(ptr));
-    return result;
+  virtual ~DeferredMILPModel() = default;
+
+  ModelledValue createVariable() {
+    return ModelVar{static_cast<std::uint32_t>(variable_count++)};
   }
-  DeferredModelledValue createDeferredVariable(const std::string& name = "") {
-    return this->createDeferredVariable(this->createVariable(name));
+  DeferredModelledValue createDeferredVariable() {
+    return this->createDeferredVariable(this->createVariable());
   }
   DeferredModelledValue createDeferredVariable(ModelledValue value) {
-    auto deferred = std::make_unique<DeferredModelVar>(value);
-    auto result = deferred.get();
-    deferred_values.push_back(std::move(deferred));
-    return result;
+    deferred_targets.push_back(value.id);
+    return DeferredModelVar{
+        static_cast<std::uint32_t>(deferred_targets.size() - 1)};
   }
   DeferredModelledValue createDeferredConstant(bool value) {
     auto var = this->createVariable();
@@ -172,11 +289,24 @@ public:
     return this->createDeferredVariable(var);
   }
 
-  void addConstraint(LinearConstraint<ModelledValue> constr) {
-    constraints.emplace_back(std::move(constr));
+  /**
+   * @brief Variable `deferred` stands for now.
+   */
+  ModelledValue target(DeferredModelledValue deferred) const {
+    return ModelVar{deferred_targets[deferred.id]};
+  }
+  void rebind(DeferredModelledValue deferred, ModelledValue var) {
+    deferred_targets[deferred.id] = var.id;
   }
-  void addConstraint(LinearConstraint<DeferredModelledValue> constr) {
-    deferred_constraints.emplace_back(std::move(constr));
+
+  void addConstraint(const LinearConstraint<ModelledValue>& constr) {
+    addRow(rows, constr);
+  }
+  void addConstraint(const LinearConstraint<DeferredModelledValue>& constr) {
+    if (completed) {
+      throw std::runtime_error("The MILP model is already complete");
+    }
+    addRow(deferred_rows, constr);
   }
 
   void setObjective(LinearExpr<DeferredModelledValue> obj,
@@ -184,64 +314,281 @@ public:
     objective = {std::move(obj), maximize};
   }
 
-  MaterializedResult gurobiLpFormat() const {
-    using namespace std::literals;
-    std::unordered_map<const ModelVar*, std::string> var_names;
-    for (auto i = 0uz; i < variables.size(); ++i) {
-      var_names[variables[i].get()] = "x"s + std::to_string(i);
-    }
-    auto printVar = [&](const auto& var) -> std::string {
-      using T = std::remove_cvref_t<decltype(var)>;
-      if constexpr (std::is_same_v<T, ModelledValue>) {
-        return var_names.at(var);
-      } else if constexpr (std::is_same_v<T, DeferredModelledValue>) {
-        return var_names.at(var->getVar());
-      } else {
-        static_assert(sizeof(T) == 0, "Unsupported var type");
-        return "";
+  /**
+   * @brief Resolve the deferred constraints and objective into plain ones,
+   * after which nothing can be rebound. Called again, does nothing.
+   */
+  virtual void complete() {
+    if (completed) {
+      return;
+    }
+    for (auto i = 0uz; i < deferred_rows.size(); i++) {
+      auto row = deferred_rows[i];
+      for (auto k = 0uz; k < row.columns.size(); k++) {
+        rows.push(deferred_targets[row.columns[k]], row.coefficients[k]);
       }
-    };
-    auto printLin = [&](auto&& expr) {
-      std::string result;
+      rows.close(row.comparator, row.rhs);
+    }
+    deferred_rows = {};
+    if (objective) {
+      auto& [expr, maximize] = *objective;
+      LinearObjective resolved{{}, {}, expr.getConstant(), maximize};
       for (auto& [var, coeff] : expr.getItems()) {
-        result += coeff >= 0 ? " + " : " - ";
-        result += std::format("{} {}", std::abs(coeff), printVar(var));
+        resolved.columns.push_back(deferred_targets[var.id]);
+        resolved.coefficients.push_back(coeff);
+      }
+      linear_objective = std::move(resolved);
+      objective.reset();
+    }
+    completed = true;
+  }
+  bool isComplete() const {
+    return completed;
+  }
+
+  /**
+   * @brief Columns of the model, i.e. the variables left by `presolve`.
+   */
+  std::size_t variableSize() const {
+    return columns_of.empty() ? variable_count : column_count;
+  }
+  /**
+   * @brief Variable ids, including those `presolve` removed.
+   */
+  std::size_t allVariableSize() const {
+    return variable_count;
+  }
+  std::size_t constraintSize() const {
+    return rows.size() + deferred_rows.size();
+  }
+  bool binary() const {
+    return allVariablesBinary;
+  }
+  /**
+   * @brief Column of `var` in `getRows` and the solver backends; variables
+   * kept by `presolve` always have one.
+   */
+  std::size_t column(ModelledValue var) const {
+    return columns_of.empty() ? var.id : columns_of.at(var.id);
+  }
+  /**
+   * @brief Constraints over the columns, once complete.
+   */
+  const LinearRows& getRows() const {
+    requireComplete();
+    return rows;
+  }
+  const std::optional<LinearObjective>& getObjective() const {
+    requireComplete();
+    return linear_objective;
+  }
+  /**
+   * @brief Bytes held by the arrays of the model.
+   */
+  std::size_t memoryUsage() const {
+    return rows.memoryUsage() + deferred_rows.memoryUsage()
+         + deferred_targets.capacity() * sizeof(std::uint32_t)
+         + columns_of.capacity() * sizeof(std::uint32_t);
+  }
+
+  struct PresolveStats {
+    std::size_t variables_before;
+    std::size_t constraints_before;
+    std::size_t variables_after;
+    std::size_t constraints_after;
+    std::size_t fixed;
+  };
+
+  /**
+   * @brief Complete the model and shrink it: fix variables forced by a
+   * constraint's bounds, substitute fixed variables into the constraints
+   * using them, drop constraints left redundant, then number the variables
+   * still used as the columns.
+   *
+   * A constraint forces its variables when its right hand side equals the
+   * least or greatest value the binaries can give it, e.g. `x = 1` for a
+   * constant or `a - b0 - b1 = 0` once `a = 0`. An infeasible model is kept
+   * infeasible with a variable bounded by `1 <= z <= 0`.
+   *
+   * @param keep Variables to keep unfixed and numbered, e.g. those the
+   * caller reads or bounds later; the objective's are kept too.
+   */
+  PresolveStats presolve(std::span<const ModelledValue> keep) {
+    constexpr double EPSILON = 1e-9;
+    complete();
+    if (!columns_of.empty()) {
+      throw std::runtime_error("The MILP model is already presolved");
+    }
+    PresolveStats stats{variableSize(), constraintSize(), 0, 0, 0};
+    auto& [starts, columns, coefficients, comparators, rhs] = rows;
+
+    std::vector<bool> kept(variable_count);
+    for (auto var : keep) {
+      kept[var.id] = true;
+    }
+    if (linear_objective) {
+      for (auto column : linear_objective->columns) {
+        kept[column] = true;
+      }
+    }
+    // -1 while free
+    std::vector<std::int8_t> fixed(variable_count, -1);
+    std::vector<bool> live(rows.size(), true);
+    bool infeasible = false;
+
+    // Fix the unkept variables of row `r` to give its greatest (or least)
+    // value; the row is then implied unless kept variables are left.
+    auto force = [&](std::size_t r, bool greatest) {
+      auto forced = false;
+      live[r] = false;
+      for (auto k = starts[r]; k < starts[r + 1]; k++) {
+        if (columns[k] == NO_COLUMN) {
+          continue;
+        }
+        if (kept[columns[k]]) {
+          live[r] = true;
+        } else {
+          fixed[columns[k]] = (coefficients[k] > 0) == greatest ? 1 : 0;
+          stats.fixed++;
+          forced = true;
+        }
       }
-      return result;
+      return forced;
     };
-    std::string lp;
-    if (objective.has_value()) {
-      auto& [expr, maximize] = *objective;
-      lp += (maximize ? "Maximize\n" : "Minimize\n");
-      lp += printLin(expr) + "\n";
+    auto changed = true;
+    while (changed && !infeasible) {
+      changed = false;
+      for (auto r = 0uz; r < rows.size(); r++) {
+        if (!live[r]) {
+          continue;
+        }
+        // substitute fixed variables, and take the range of the left hand
+        // side over the binaries left
+        double least = 0, greatest = 0;
+        for (auto k = starts[r]; k < starts[r + 1]; k++) {
+          if (columns[k] == NO_COLUMN) {
+            continue;
+          }
+          if (auto value = fixed[columns[k]]; value >= 0) {
+            rhs[r] -= coefficients[k] * value;
+            columns[k] = NO_COLUMN;
+          } else {
+            (coefficients[k] > 0 ? greatest : least) += coefficients[k];
+          }
+        }
+        auto below = comparators[r] != Comparator::GreaterEqual;
+        auto above = comparators[r] != Comparator::LessEqual;
+        if ((below && least > rhs[r] + EPSILON)
+            || (above && greatest < rhs[r] - EPSILON)) {
+          infeasible = true;
+          break;
+        }
+        if ((!below || greatest <= rhs[r] + EPSILON)
+            && (!above || least >= rhs[r] - EPSILON)) {
+          live[r] = false;
+        } else if (above && std::abs(greatest - rhs[r]) <= EPSILON) {
+          changed |= force(r, true);
+        } else if (below && std::abs(least - rhs[r]) <= EPSILON) {
+          changed |= force(r, false);
+        }
+      }
     }
-    lp += "Subject To\n";
-    for (auto& [lhs, comparator, rhs] : constraints) {
-      lp += printLin(lhs) + " ";
-      switch (comparator) {
-        case Comparator::Equal: lp += "= "; break;
-        case Comparator::LessEqual: lp += "<= "; break;
-        case Comparator::GreaterEqual: lp += ">= "; break;
+
+    if (infeasible) {
+      live.assign(live.size(), false);
+      auto z = createVariable();
+      kept.push_back(true);
+      rows.push(z.id, 1);
+      rows.close(Comparator::GreaterEqual, 1);
+      rows.push(z.id, 1);
+      rows.close(Comparator::LessEqual, 0);
+      live.push_back(true);
+      live.push_back(true);
+    }
+
+    // number the variables still used, keeping their order
+    std::vector<bool> used = kept;
+    for (auto r = 0uz; r < rows.size(); r++) {
+      if (!live[r]) {
+        continue;
+      }
+      for (auto k = starts[r]; k < starts[r + 1]; k++) {
+        if (columns[k] != NO_COLUMN) {
+          used[columns[k]] = true;
+        }
+      }
+    }
+    columns_of.assign(variable_count, NO_COLUMN);
+    column_count = 0;
+    for (auto id = 0uz; id < variable_count; id++) {
+      if (used[id]) {
+        columns_of[id] = static_cast<std::uint32_t>(column_count++);
+      }
+    }
+    LinearRows presolved;
+    for (auto r = 0uz; r < rows.size(); r++) {
+      if (!live[r]) {
+        continue;
       }
-      lp += std::to_string(rhs - lhs.getConstant()) + "\n";
+      for (auto k = starts[r]; k < starts[r + 1]; k++) {
+        if (columns[k] != NO_COLUMN) {
+          presolved.push(columns_of[columns[k]], coefficients[k]);
+        }
+      }
+      presolved.close(comparators[r], rhs[r]);
+    }
+    rows = std::move(presolved);
+    if (linear_objective) {
+      for (auto& column : linear_objective->columns) {
+        column = columns_of[column];
+      }
+    }
+
+    stats.variables_after = variableSize();
+    stats.constraints_after = constraintSize();
+    return stats;
+  }
+
+  /**
+   * @brief Write the complete model in LP format, column `i` named `x<i>`.
+   */
+  void writeLp(std::ostream& os) const {
+    requireComplete();
+    auto printLin = [&](std::span<const std::uint32_t> columns,
+                        std::span<const double> coefficients) {
+      for (auto k = 0uz; k < columns.size(); k++) {
+        auto coeff = coefficients[k];
+        std::print(os, "{} {} x{}", coeff >= 0 ? " +" : " -", std::abs(coeff),
+                   columns[k]);
+      }
+    };
+    // an empty objective for feasibility models
+    if (linear_objective.has_value()) {
+      auto& [columns, coefficients, constant, maximize] = *linear_objective;
+      os << (maximize ? "Maximize\n" : "Minimize\n");
+      printLin(columns, coefficients);
+    } else {
+      os << "Minimize\n";
     }
-    for (auto& [lhs, comparator, rhs] : deferred_constraints) {
-      lp += printLin(lhs) + " ";
+    os << '\n';
+    os << "Subject To\n";
+    for (auto i = 0uz; i < rows.size(); i++) {
+      auto [columns, coefficients, comparator, rhs] = rows[i];
+      printLin(columns, coefficients);
       switch (comparator) {
-        case Comparator::Equal: lp += "= "; break;
-        case Comparator::LessEqual: lp += "<= "; break;
-        case Comparator::GreaterEqual: lp += ">= "; break;
+        case Comparator::Equal: os << " = "; break;
+        case Comparator::LessEqual: os << " <= "; break;
+        case Comparator::GreaterEqual: os << " >= "; break;
       }
-      lp += std::to_string(rhs - lhs.getConstant()) + "\n";
+      std::println(os, "{}", rhs);
     }
     if (allVariablesBinary) {
-      lp += "Binary\n";
-      for (auto& [_, name] : var_names) {
-        lp += name + "\n";
+      os << "Binary\n";
+      for (auto i = 0uz; i < variableSize(); ++i) {
+        std::println(os, "x{}", i);
       }
     }
-    return {.variableNames = std::move(var_names), .lpContent = std::move(lp)};
   }
 };
 
-}  // namespace bonc
\ No newline at end of file
+}  // namespace bonc
@@ -1,26 +1,100 @@
+#pragma once
+
+#include <lookup_table.h>
+
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
 #include "deferred-milp-model.hpp"
+#include "polyhedron.h"
 
 namespace bonc {
 namespace dp {
 
+/**
+ * @brief The division trail operations a `MILPModel` was built from, kept so
+ * other engines can encode the same trails. Deferred operands are resolved
+ * like the constraints, once the model is complete.
+ */
+namespace operation {
+
+struct Constant {
+  ModelledValue var;
+  bool value;
+};
+struct Copy {
+  ModelledValue from;
+  std::vector<ModelledValue> to;
+};
+struct Xor {
+  DeferredModelledValue lhs;
+  DeferredModelledValue rhs;
+  DeferredModelledValue result;
+};
+struct And {
+  DeferredModelledValue lhs;
+  DeferredModelledValue rhs;
+  DeferredModelledValue result;
+};
+struct Lookup {
+  Ref<LookupTable> table;
+  // inputs, then outputs
+  std::vector<DeferredModelledValue> vars;
+};
+
+}  // namespace operation
+
+using Operation =
+    std::variant<operation::Constant, operation::Copy, operation::Xor,
+                 operation::And, operation::Lookup>;
+
 class MILPModel : public DeferredMILPModel {
+private:
+  std::vector<Operation> operations;
+  // every branch made by `copy`, to the copy it can be widened in
+  std::unordered_map<ModelledValue, std::size_t> copy_branches;
+
 public:
   MILPModel() : DeferredMILPModel{} {}
 
+  const std::vector<Operation>& getOperations() const {
+    return operations;
+  }
+
+  DeferredModelledValue constant(bool value) {
+    auto result = this->createDeferredConstant(value);
+    operations.push_back(operation::Constant{this->target(result), value});
+    return result;
+  }
+
   /**
    * Denote (a) → (b0, b1) a division trail of Copy function, the following
    * inequality is sufficient to describe the division propagation of Copy.
    * `a − b0 − b1 = 0`
    * `a, b0 , b1 are binaries`
    * @ref http://doi.org/10.1007/978-3-662-53887-6_24
+   *
+   * Copying a branch of an earlier copy of the same value adds a branch to
+   * that copy instead, `a − b0 − ... − bk = 0`, rather than chaining
+   * another pair of variables. The constraints are added by `complete`, once
+   * no copy can widen anymore.
    */
   DeferredModelledValue copy(DeferredModelledValue from) {
-    // std::abort();
-    auto a = from->getVar();
+    auto a = this->target(from);
+    if (auto it = copy_branches.find(a); it != copy_branches.end()) {
+      auto index = it->second;
+      auto b = this->createVariable();
+      std::get<operation::Copy>(operations[index]).to.push_back(b);
+      copy_branches.emplace(b, index);
+      return this->createDeferredVariable(b);
+    }
     auto b0 = this->createVariable();
     auto b1 = this->createVariable();
-    this->addConstraint(LinearExpr<ModelledValue>{a} - b0 - b1 == 0);
-    from->setVar(b0);
+    copy_branches.emplace(b0, operations.size());
+    copy_branches.emplace(b1, operations.size());
+    operations.push_back(operation::Copy{a, {b0, b1}});
+    this->rebind(from, b0);
     auto b1_deferred = this->createDeferredVariable(b1);
     return b1_deferred;
   }
@@ -29,6 +103,7 @@ public:
                              DeferredModelledValue a1) {
     auto b = this->createDeferredVariable();
     this->addConstraint(LinearExpr<DeferredModelledValue>{} + a0 + a1 - b == 0);
+    operations.push_back(operation::Xor{a0, a1, b});
     return b;
   }
 
@@ -39,8 +114,43 @@ public:
     this->addConstraint(b_expr - a0 >= 0);
     this->addConstraint(b_expr - a1 >= 0);
     this->addConstraint(b_expr - a0 - a1 <= 0);
+    operations.push_back(operation::And{a0, a1, b});
     return b;
   }
+
+  /**
+   * @brief Division trails of `table` from `vars`, inputs then outputs, as
+   * the convex hull inequalities `inequalities` that keep exactly them.
+   */
+  void lookup(Ref<LookupTable> table, std::vector<DeferredModelledValue> vars,
+              const std::vector<PolyhedronInequality>& inequalities) {
+    for (const auto& [coeff, constant] : inequalities) {
+      std::vector<LinearExprItem<DeferredModelledValue>> items;
+      for (auto i = 0uz; i < vars.size(); i++) {
+        items.emplace_back(vars[i], coeff.at(i));
+      }
+      this->addConstraint(
+          LinearExpr<DeferredModelledValue>(std::move(items), constant) >= 0);
+    }
+    operations.push_back(operation::Lookup{std::move(table), std::move(vars)});
+  }
+
+  void complete() override {
+    if (this->isComplete()) {
+      return;
+    }
+    for (auto& operation : operations) {
+      if (auto copy = std::get_if<operation::Copy>(&operation)) {
+        std::vector<LinearExprItem<ModelledValue>> items{{copy->from}};
+        for (auto branch : copy->to) {
+          items.emplace_back(branch, -1.0);
+        }
+        this->addConstraint(LinearExpr<ModelledValue>(std::move(items)) == 0);
+      }
+    }
+    copy_branches.clear();
+    DeferredMILPModel::complete();
+  }
 };
 
 }  // namespace dp
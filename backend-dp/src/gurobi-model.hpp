@@ -0,0 +1,107 @@
+#pragma once
+
+#include <gurobi_c++.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "deferred-milp-model.hpp"
+
+namespace bonc {
+
+namespace dp {
+
+/**
+ * @brief Add the variables, constraints and objective of a model to Gurobi
+ * through its API, without the LP text round trip.
+ *
+ * Variables are added in one call and constraints in batches of
+ * `BATCH_SIZE`, so Gurobi grows its matrix a few times only.
+ */
+class GurobiModelBuilder {
+private:
+  static constexpr std::size_t BATCH_SIZE = 1 << 14;
+
+  GRBModel& model;
+  std::vector<GRBVar> vars;
+
+  // scratch for `linear`, reused by every expression
+  std::vector<GRBVar> terms;
+
+  GRBLinExpr linear(std::span<const std::uint32_t> columns,
+                    std::span<const double> coefficients) {
+    terms.clear();
+    for (auto column : columns) {
+      terms.push_back(vars[column]);
+    }
+    GRBLinExpr result;
+    result.addTerms(coefficients.data(), terms.data(),
+                    static_cast<int>(terms.size()));
+    return result;
+  }
+
+  static char sense(Comparator comparator) {
+    switch (comparator) {
+      case Comparator::Equal: return GRB_EQUAL;
+      case Comparator::LessEqual: return GRB_LESS_EQUAL;
+      case Comparator::GreaterEqual: return GRB_GREATER_EQUAL;
+    }
+    std::unreachable();
+  }
+
+  void addConstraints(const LinearRows& rows) {
+    std::vector<GRBLinExpr> lhs;
+    std::vector<char> senses;
+    for (auto first = 0uz; first < rows.size(); first += BATCH_SIZE) {
+      auto count = std::min(BATCH_SIZE, rows.size() - first);
+      lhs.clear();
+      senses.clear();
+      for (auto i = first; i < first + count; i++) {
+        auto row = rows[i];
+        lhs.push_back(linear(row.columns, row.coefficients));
+        senses.push_back(sense(row.comparator));
+      }
+      std::unique_ptr<GRBConstr[]> added{model.addConstrs(
+          lhs.data(), senses.data(), rows.rhs.data() + first, nullptr,
+          static_cast<int>(count))};
+    }
+  }
+
+public:
+  explicit GurobiModelBuilder(GRBModel& model) : model{model} {}
+
+  /**
+   * @brief Add the complete `milp` to the model, which should be empty.
+   */
+  void build(const DeferredMILPModel& milp) {
+    auto count = milp.variableSize();
+    std::vector<char> types(count,
+                            milp.binary() ? GRB_BINARY : GRB_CONTINUOUS);
+    std::unique_ptr<GRBVar[]> added{model.addVars(
+        nullptr, nullptr, nullptr, types.data(), nullptr,
+        static_cast<int>(count))};
+    vars.assign(added.get(), added.get() + count);
+    addConstraints(milp.getRows());
+    if (auto& objective = milp.getObjective()) {
+      auto& [columns, coefficients, constant, maximize] = *objective;
+      model.setObjective(linear(columns, coefficients) + constant,
+                         maximize ? GRB_MAXIMIZE : GRB_MINIMIZE);
+    }
+    model.update();
+  }
+
+  /**
+   * @brief Gurobi variable of a model column, after `build`.
+   */
+  GRBVar variable(std::size_t column) const {
+    return vars.at(column);
+  }
+};
+
+}  // namespace dp
+
+}  // namespace bonc
@@ -0,0 +1,158 @@
+#include "inequality_cache.h"
+
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "sbox_modelling.h"
+
+namespace bonc::dp {
+
+namespace {
+
+// "<input width> <output width> <values...>", also the key line in files
+std::string tableKey(const LookupTable& sbox) {
+  auto key = std::format("{} {}", sbox.getInputWidth(), sbox.getOutputWidth());
+  for (auto value : sbox.tableData()) {
+    key += std::format(" {}", value);
+  }
+  return key;
+}
+
+constexpr std::string_view reductionName(InequalityReduction reduction) {
+  switch (reduction) {
+    case InequalityReduction::Greedy:
+      return "greedy";
+    case InequalityReduction::Minimal:
+      return "minimal";
+  }
+  std::unreachable();
+}
+
+}  // namespace
+
+const SBoxInequalities& InequalityCache::get(const Ref<LookupTable>& sbox) {
+  std::lock_guard lock{mutex};
+  if (auto it = by_table.find(sbox.get()); it != by_table.end()) {
+    reused++;
+    return *it->second;
+  }
+  auto& entry = entries[tableKey(*sbox)];
+  by_table.emplace(sbox.get(), &entry);
+  // loaded entries only carry the inequalities
+  if (entry.trails.empty()) {
+    entry.trails = divisionPropertyTrail(sbox);
+  }
+  if (entry.inequalities.empty() || entry.reduction < reduction) {
+    auto hull = vToH(entry.trails);
+    entry.inequalities =
+        reduction == InequalityReduction::Minimal
+            ? minimizeInequalities(hull, entry.trails, time_limit, threads)
+            : reduceInequalities(hull, entry.trails, threads);
+    entry.reduction = reduction;
+    computed++;
+  } else {
+    reused++;
+  }
+  return entry;
+}
+
+/**
+ * File format, per S-box:
+ *
+ *     sbox <input width> <output width> <values...>
+ *     <inequality count> [greedy|minimal]
+ *     <constant term> <coefficients...>
+ *     ...
+ */
+void InequalityCache::load(const std::string& path) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    return;
+  }
+  std::lock_guard lock{mutex};
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    if (!line.starts_with("sbox ")) {
+      throw std::runtime_error(
+          std::format("Invalid inequality cache {}: {}", path, line));
+    }
+    auto key = line.substr(5);
+    std::size_t input_width, output_width, count;
+    std::istringstream(key) >> input_width >> output_width;
+    // files from before the reduction was recorded are greedy
+    std::string count_line, method{"greedy"};
+    std::getline(ifs, count_line);
+    std::istringstream count_stream{count_line};
+    if (!(count_stream >> count)) {
+      throw std::runtime_error(
+          std::format("Invalid inequality cache {}: no count", path));
+    }
+    count_stream >> method;
+    auto reduction = InequalityReduction::Greedy;
+    if (method == reductionName(InequalityReduction::Minimal)) {
+      reduction = InequalityReduction::Minimal;
+    } else if (method != reductionName(InequalityReduction::Greedy)) {
+      throw std::runtime_error(
+          std::format("Invalid inequality cache {}: {}", path, count_line));
+    }
+    std::vector<PolyhedronInequality> inequalities(count);
+    for (auto& inequality : inequalities) {
+      inequality.coefficients.resize(input_width + output_width);
+      ifs >> inequality.constant_term;
+      for (auto& coefficient : inequality.coefficients) {
+        ifs >> coefficient;
+      }
+    }
+    if (!ifs) {
+      throw std::runtime_error(
+          std::format("Invalid inequality cache {}: truncated", path));
+    }
+    ifs >> std::ws;
+    auto& entry = entries[key];
+    if (entry.inequalities.empty() || entry.reduction < reduction) {
+      entry.inequalities = std::move(inequalities);
+      entry.reduction = reduction;
+    }
+  }
+}
+
+void InequalityCache::save(const std::string& path) const {
+  std::ofstream ofs(path);
+  if (!ofs) {
+    throw std::runtime_error(std::format("Failed to write {}", path));
+  }
+  std::lock_guard lock{mutex};
+  for (auto& [key, entry] : entries) {
+    if (entry.inequalities.empty()) {
+      continue;
+    }
+    ofs << "sbox " << key << '\n' << entry.inequalities.size() << ' '
+        << reductionName(entry.reduction) << '\n';
+    for (auto& inequality : entry.inequalities) {
+      ofs << inequality.constant_term;
+      for (auto coefficient : inequality.coefficients) {
+        ofs << ' ' << coefficient;
+      }
+      ofs << '\n';
+    }
+  }
+}
+
+std::size_t InequalityCache::computedSize() const {
+  std::lock_guard lock{mutex};
+  return computed;
+}
+
+std::size_t InequalityCache::reusedSize() const {
+  std::lock_guard lock{mutex};
+  return reused;
+}
+
+}  // namespace bonc::dp
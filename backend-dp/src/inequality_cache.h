@@ -0,0 +1,95 @@
+#pragma once
+
+#include <lookup_table.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "polyhedron.h"
+
+namespace bonc {
+
+namespace dp {
+
+/**
+ * @brief How the convex hull inequalities of an S-box are reduced, worst
+ * result first.
+ */
+enum class InequalityReduction {
+  /**
+   * @brief `reduceInequalities`
+   */
+  Greedy,
+  /**
+   * @brief `minimizeInequalities`
+   */
+  Minimal,
+};
+
+/**
+ * @brief Division property model of one S-box: its trails, and the reduced
+ * inequalities whose 0/1 solutions are exactly those trails.
+ */
+struct SBoxInequalities {
+  std::vector<PolyhedronVertex> trails;
+  std::vector<PolyhedronInequality> inequalities;
+  InequalityReduction reduction{InequalityReduction::Greedy};
+};
+
+/**
+ * @brief Builds the trails, convex hull and reduced inequalities of each
+ * S-box once, for all of its instances.
+ *
+ * Entries are keyed by the table contents, so equal S-boxes share them and
+ * the inequalities can be saved and loaded again by a later run. Loaded
+ * inequalities reduced by a weaker method than asked for are reduced again.
+ */
+class InequalityCache {
+private:
+  mutable std::mutex mutex;
+  std::map<std::string, SBoxInequalities> entries;
+  std::unordered_map<const LookupTable*, SBoxInequalities*> by_table;
+  std::size_t threads;
+  InequalityReduction reduction;
+  std::chrono::milliseconds time_limit;
+  std::size_t computed{0};
+  std::size_t reused{0};
+
+public:
+  /**
+   * @param threads Threads used to reduce the inequalities
+   * @param time_limit Per S-box, for `InequalityReduction::Minimal`
+   */
+  explicit InequalityCache(
+      std::size_t threads = 1,
+      InequalityReduction reduction = InequalityReduction::Greedy,
+      std::chrono::milliseconds time_limit = std::chrono::minutes{1})
+      : threads{threads}, reduction{reduction}, time_limit{time_limit} {}
+  InequalityCache(const InequalityCache&) = delete;
+  InequalityCache& operator=(const InequalityCache&) = delete;
+
+  const SBoxInequalities& get(const Ref<LookupTable>& sbox);
+
+  /**
+   * @brief Add the inequalities saved in `path`, if it exists.
+   */
+  void load(const std::string& path);
+  void save(const std::string& path) const;
+
+  /**
+   * @brief S-boxes whose inequalities were computed in this run.
+   */
+  std::size_t computedSize() const;
+  /**
+   * @brief Lookups served without computing anything.
+   */
+  std::size_t reusedSize() const;
+};
+
+}  // namespace dp
+
+}  // namespace bonc
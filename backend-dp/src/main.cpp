@@ -1,14 +1,24 @@
 #include <frontend_result_parser.h>
+#ifdef USE_GUROBI
 #include <gurobi_c++.h>
+#endif
 #include <sbox_and_input.h>
 #include <perf.h>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
+#include <cerrno>
+#include <cstdio>
 #include <fstream>
 #include <print>
+#include <span>
 
-#include "sbox_modelling.h"
+#include "inequality_cache.h"
+#include "milp_solver.h"
+#include "sat_engine.h"
 
 struct EnabledStreamableTypes : boost::program_options::options_description {};
 
@@ -48,6 +58,7 @@ class DivisionPropertyModeller {
                      std::vector<bonc::dp::TraverseResult>>
       traversed_sbox_inputs;
   bonc::dp::MILPModel model;
+  bonc::dp::InequalityCache& inequalities;
 
   bonc::dp::TraverseResult traverseImpl(bonc::Ref<bonc::BitExpr> expr) {
     using Um = bonc::UnmodelledValue;
@@ -68,12 +79,9 @@ class DivisionPropertyModeller {
         if (target->getKind() == bonc::ReadTarget::Input) {
           if (auto it = active_bits.find(target->getName());
               it != active_bits.end()) {
-            if (it->second.find(offset) != it->second.end()) {
-              return R::makeModelled(model.createDeferredConstant(true), model);
-            } else {
-              return R::makeModelled(model.createDeferredConstant(false),
-                                     model);
-            }
+            return R::makeModelled(
+                model.constant(it->second.find(offset) != it->second.end()),
+                model);
           } else {
             return R::makeUnmodelled(Um::Unspecified);
           }
@@ -107,19 +115,7 @@ class DivisionPropertyModeller {
             std::ranges::generate_n(
                 std::back_inserter(vars), sbox->getOutputWidth(),
                 [&]() { return model.createDeferredVariable(); });
-
-            auto vertices = divisionPropertyTrail(std::move(sbox));
-            auto inequalities = vToH(vertices);
-            auto reduced = reduceInequalities(inequalities, vertices);
-            for (const auto& [coeff, constant] : reduced) {
-              std::vector<bonc::LinearExprItem<Mo>> items;
-              std::ranges::transform(vars, coeff, std::back_inserter(items),
-                                     [](const Mo& var, int c) {
-                                       return bonc::LinearExprItem<Mo>(var, c);
-                                     });
-              auto expr = bonc::LinearExpr<Mo>(std::move(items), constant);
-              model.addConstraint(std::move(expr) >= 0);
-            }
+            model.lookup(sbox, vars, inequalities.get(sbox).inequalities);
             outputs = vars | std::views::drop(inputs.size())
                     | std::views::transform([&](const Mo& var) {
                         return R::makeModelled(var, model);
@@ -224,7 +220,8 @@ class DivisionPropertyModeller {
   }
 
 public:
-  DivisionPropertyModeller() = default;
+  explicit DivisionPropertyModeller(bonc::dp::InequalityCache& inequalities)
+      : inequalities{inequalities} {}
 
   void addActiveBits(const std::string& name,
                      std::unordered_set<int> active_bits) {
@@ -248,31 +245,308 @@ public:
     }
   }
 
-  auto finalize() {
-    this->model.setObjective(std::ranges::fold_left(
-        outputs, bonc::LinearExpr<bonc::DeferredModelledValue>{}, std::plus{}));
-    return this->model.gurobiLpFormat();
+  /**
+   * @param unit Constrain the outputs to a unit vector instead of minimising
+   * their sum, so that any feasible solution is one.
+   */
+  bonc::dp::MILPModel& finalize(bool unit = false) {
+    auto sum = std::ranges::fold_left(
+        outputs, bonc::LinearExpr<bonc::DeferredModelledValue>{}, std::plus{});
+    if (unit) {
+      this->model.addConstraint(std::move(sum) == 1);
+    } else {
+      this->model.setObjective(std::move(sum));
+    }
+    this->model.complete();
+    return this->model;
   }
 
-  std::unordered_set<const bonc::ModelVar*> getOutputs() const {
-    std::unordered_set<const bonc::ModelVar*> result;
+  std::unordered_set<bonc::ModelledValue> getOutputs() const {
+    std::unordered_set<bonc::ModelledValue> result;
     for (auto var : outputs) {
-      result.insert(var->getVar());
+      result.insert(model.target(var));
     }
     return result;
   }
 };
 
+/**
+ * @brief Output columns found to reach the unit vector, and the solves it
+ * took.
+ */
+struct UnitSearch {
+  std::vector<std::size_t> reachable;
+  std::size_t solves{0};
+};
+
+/**
+ * @brief Find the outputs of `shard` that still reach the unit vector: while
+ * some does, forbid it, until none or more than one is reachable. Outputs
+ * outside `shard` are forbidden first.
+ *
+ * Every solution the solver kept is harvested, so one solve can forbid as
+ * many outputs as its pool holds unit vectors.
+ */
+UnitSearch searchUnitOutputs(bonc::dp::MILPSolver& solver,
+                             std::span<const std::size_t> outputs,
+                             std::span<const std::size_t> shard) {
+  using Status = bonc::dp::MILPSolver::Status;
+  std::unordered_set<std::size_t> remaining(shard.begin(), shard.end());
+  for (auto v : outputs) {
+    if (!remaining.contains(v)) {
+      solver.setUpperBound(v, 0);
+    }
+  }
+
+  UnitSearch result;
+  while (!remaining.empty()) {
+    auto status = solver.optimize();
+    result.solves++;
+    if (status == Status::Infeasible
+        || (status == Status::Optimal && solver.objectiveValue() > 1)) {
+      break;
+    }
+    if (status != Status::Optimal) {
+      throw std::runtime_error("Unknown error!");
+    }
+    std::cout << "COUNTER = " << result.reachable.size() << "\n";
+    std::vector<std::size_t> units;
+    for (auto solution = 0uz; solution < solver.solutionCount(); solution++) {
+      auto unit = 0uz;
+      auto ones = 0uz;
+      for (auto v : remaining) {
+        if (std::abs(solver.value(v, solution) - 1) < 1e-6) {
+          unit = v;
+          ones++;
+        }
+      }
+      if (ones == 1) {
+        units.push_back(unit);
+      }
+    }
+    if (units.empty()) {
+      throw std::runtime_error("No unit vector among the optimal solutions");
+    }
+    for (auto v : units) {
+      if (remaining.erase(v)) {
+        result.reachable.push_back(v);
+        solver.setUpperBound(v, 0);
+      }
+    }
+  }
+  return result;
+}
+
+/**
+ * @brief Print the "Distinguisher found" report: there is one if some output
+ * never reaches the unit vector.
+ */
+void reportDistinguisher(std::span<const std::size_t> reachable,
+                         std::size_t output_count) {
+  if (reachable.size() < output_count) {
+    std::println("Distinguisher found!");
+    for (auto column : reachable) {
+      std::print("x{} ", column);
+    }
+    std::println("");
+  } else {
+    std::println("No distinguisher found.");
+  }
+}
+
+/**
+ * @brief Solver options shared by the in-process and the sharded search.
+ */
+struct SolverSetup {
+  std::string name;
+  std::size_t threads;
+  std::size_t pool_solutions;
+  // read the model from this LP file instead of building it
+  std::optional<std::string> lp_file;
+
+  std::unique_ptr<bonc::dp::MILPSolver> create(
+      const bonc::dp::MILPModel& milp) const {
+    auto solver = bonc::dp::createMILPSolver(name);
+    solver->setThreads(threads);
+    solver->setSolutionPool(pool_solutions);
+    if (lp_file) {
+      solver->read(*lp_file);
+    } else {
+      solver->load(milp);
+    }
+    return solver;
+  }
+};
+
+/**
+ * @brief `searchUnitOutputs` over disjoint shards of the outputs, each in a
+ * forked worker with its own solver model.
+ *
+ * Workers inherit the finished `milp` and report their results as words
+ * over a pipe: a status, the solves, then the positions of the reachable
+ * outputs in `outputs`, or the error message one character per word.
+ */
+UnitSearch searchUnitOutputsSharded(
+    const SolverSetup& setup, const bonc::dp::MILPModel& milp,
+    std::span<const std::size_t> outputs, std::size_t workers) {
+  enum : std::uint64_t { Done, Failed };
+  workers = std::min(workers, outputs.size());
+  // the children would flush what is buffered again
+  std::cout.flush();
+  std::fflush(stdout);
+  struct Worker {
+    pid_t pid;
+    int fd;
+  };
+  std::vector<Worker> children;
+  for (auto w = 0uz; w < workers; w++) {
+    int fds[2];
+    if (::pipe(fds) != 0) {
+      throw std::runtime_error("Failed to create worker pipe");
+    }
+    auto pid = ::fork();
+    if (pid < 0) {
+      throw std::runtime_error("Failed to fork worker");
+    }
+    if (pid == 0) {
+      ::close(fds[0]);
+      std::vector<std::uint64_t> words;
+      try {
+        std::vector<std::size_t> shard;
+        for (auto i = w; i < outputs.size(); i += workers) {
+          shard.push_back(outputs[i]);
+        }
+        auto result = searchUnitOutputs(*setup.create(milp), outputs, shard);
+        words = {Done, result.solves};
+        for (auto v : result.reachable) {
+          words.push_back(static_cast<std::uint64_t>(
+              std::ranges::find(outputs, v) - outputs.begin()));
+        }
+      } catch (const std::exception& e) {
+        words.assign({Failed});
+        words.append_range(std::string_view{e.what()});
+      } catch (...) {
+        words.assign({Failed});
+        words.append_range(std::string_view{"MILP solver error"});
+      }
+      std::fflush(stdout);
+      auto data = reinterpret_cast<const char*>(words.data());
+      auto size = words.size() * sizeof(std::uint64_t);
+      while (size > 0) {
+        auto n = ::write(fds[1], data, size);
+        if (n <= 0 && errno != EINTR) {
+          break;
+        }
+        if (n > 0) {
+          data += n;
+          size -= n;
+        }
+      }
+      // skip the parent's atexit handlers and static destructors
+      ::_exit(0);
+    }
+    ::close(fds[1]);
+    children.push_back({pid, fds[0]});
+  }
+
+  UnitSearch result;
+  std::optional<std::string> error;
+  for (auto& [pid, fd] : children) {
+    std::vector<std::uint64_t> words;
+    std::uint64_t word;
+    std::size_t filled = 0;
+    while (true) {
+      auto n = ::read(fd, reinterpret_cast<char*>(&word) + filled,
+                      sizeof(word) - filled);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      filled += n;
+      if (filled == sizeof(word)) {
+        words.push_back(word);
+        filled = 0;
+      }
+    }
+    ::close(fd);
+    ::waitpid(pid, nullptr, 0);
+    if (words.empty()) {
+      error = "Worker exited";
+    } else if (words[0] == Failed) {
+      error.emplace();
+      for (auto c : words | std::views::drop(1)) {
+        error->push_back(static_cast<char>(c));
+      }
+    } else {
+      result.solves += words.at(1);
+      for (auto position : words | std::views::drop(2)) {
+        result.reachable.push_back(outputs[position]);
+      }
+    }
+  }
+  if (error) {
+    throw std::runtime_error(*error);
+  }
+  return result;
+}
+
+/**
+ * @brief `searchUnitOutputs` with every output bit checked on its own
+ * under assumptions, in one SAT solver.
+ */
+void searchDistinguisherSAT(const bonc::dp::MILPModel& milp,
+                            bonc::dp::InequalityCache& inequalities,
+                            std::span<const bonc::ModelledValue> outputs) {
+  bonc::backend_common::Timer timer;
+  bonc::dp::SATDivisionChecker checker{milp, inequalities};
+  std::println("SAT model build time: {}, variables: {}, clauses: {}, "
+               "S-box templates: {}",
+               timer.elapsed_as<std::chrono::milliseconds>(),
+               checker.variableSize(), checker.clauseSize(),
+               checker.templateSize());
+  timer.reset();
+  std::vector<std::size_t> reachable;
+  for (auto output : outputs) {
+    if (checker.unitReachable(output, outputs)) {
+      reachable.push_back(milp.column(output));
+    }
+  }
+  reportDistinguisher(reachable, outputs.size());
+  std::println("Solving {} outputs with SAT, time: {}, peak mem: {}kB",
+               outputs.size(), timer.elapsed_as<std::chrono::milliseconds>(),
+               bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
+}
+
 int main(int argc, char** argv) try {
   namespace po = boost::program_options;
   po::options_description desc("Allowed options");
+  auto solvers = bonc::dp::availableMILPSolvers();
+  auto available_solvers = boost::algorithm::join(
+      solvers | std::views::transform([](auto name) {
+        return std::string{name};
+      }),
+      ",");
   // clang-format off
   desc.add_options()
     ("help", "Print help message")
     ("input", po::value<std::string>()->required(), "Input file containing the frontend result in JSON format")
     ("active-bits,I", po::value<std::string>()->default_value(""), "Specify active bits as initial DP, format \"name1=range;name2=range;...\". Range is comma-separated numbers or a-b for contiguous ranges, e.g., \"0,2,4-7\"")
     ("output-bits,O", po::value<std::string>(), "Specify output bits as target final DP, format \"name1=range;name2=range;...\". Defaults to all output bits. Range is comma-separated numbers or a-b for contiguous ranges, e.g., \"0,2,4-7\"")
-    ("output,o", po::value<std::string>()->default_value("output.lp"), "Output LP file")
+    ("output,o", po::value<std::string>(), "Also write the model to this LP file")
+    ("engine", po::value<std::string>()->default_value("milp"), "How the output bits are checked: milp with --solver, sat with CryptoMiniSat, or both to compare them")
+    ("solver", po::value<std::string>()->default_value(solvers.empty() ? "" : std::string{solvers.front()}), std::format("MILP solvers to search with, comma separated, each on the same model; built: {}", available_solvers).c_str())
+    ("objective", po::value<std::string>()->default_value("unit"), "MILP formulation: unit to constrain the outputs to unit vectors and take any feasible one, or sum to minimise the output weight")
+    ("pool-solutions", po::value<std::size_t>()->default_value(10), "Solutions the MILP solver keeps per solve, each of which can retire an output bit")
+    ("no-presolve", "Emit the MILP model as built, without fixing and substituting constants or dropping redundant constraints")
+    ("workers", po::value<std::size_t>()->default_value(1), "Worker processes checking disjoint shards of the output bits, each with its own solver model")
+    ("solver-threads", po::value<std::size_t>()->default_value(0), "Threads of each MILP solver, 0 for the solver default")
+    ("build", po::value<std::string>()->default_value("direct"), "How the solver model is built: direct through its API, or lp to write the LP file (--output, or output.lp) and read it back")
+    ("reduce", po::value<std::string>()->default_value("greedy"), "How S-box inequalities are reduced: greedy, or minimal for the fewest found by CryptoMiniSat within --reduce-time-limit")
+    ("reduce-time-limit", po::value<std::size_t>()->default_value(60), "Seconds spent on each S-box by --reduce minimal")
+    ("reduce-threads", po::value<std::size_t>()->default_value(1), "Threads scoring the inequalities of an S-box before reducing them")
+    ("inequality-cache", po::value<std::string>(), "File keeping the reduced S-box inequalities across runs; read if it exists, and updated with newly computed ones")
   ;
   // clang-format on
 
@@ -299,7 +573,40 @@ int main(int argc, char** argv) try {
 
   bonc::backend_common::Timer timer;
 
-  auto modeller = DivisionPropertyModeller{};
+  auto build = vm["build"].as<std::string>();
+  if (build != "direct" && build != "lp") {
+    throw std::runtime_error(std::format("Unknown model build: {}", build));
+  }
+  auto objective = vm["objective"].as<std::string>();
+  if (objective != "unit" && objective != "sum") {
+    throw std::runtime_error(std::format("Unknown objective: {}", objective));
+  }
+  auto engine = vm["engine"].as<std::string>();
+  if (engine != "milp" && engine != "sat" && engine != "both") {
+    throw std::runtime_error(std::format("Unknown engine: {}", engine));
+  }
+  std::vector<std::string> solver_names;
+  boost::split(solver_names, vm["solver"].as<std::string>(),
+               boost::is_any_of(","));
+  for (auto& name : solver_names) {
+    if (engine != "sat" && !std::ranges::contains(solvers, name)) {
+      throw std::runtime_error(
+          std::format("MILP solver {} is unknown or not enabled", name));
+    }
+  }
+  auto reduce = vm["reduce"].as<std::string>();
+  if (reduce != "greedy" && reduce != "minimal") {
+    throw std::runtime_error(std::format("Unknown reduction: {}", reduce));
+  }
+  bonc::dp::InequalityCache inequalities{
+      vm["reduce-threads"].as<std::size_t>(),
+      reduce == "minimal" ? bonc::dp::InequalityReduction::Minimal
+                          : bonc::dp::InequalityReduction::Greedy,
+      std::chrono::seconds{vm["reduce-time-limit"].as<std::size_t>()}};
+  if (vm.count("inequality-cache")) {
+    inequalities.load(vm["inequality-cache"].as<std::string>());
+  }
+  auto modeller = DivisionPropertyModeller{inequalities};
   std::vector<std::string> input_blocks;
   boost::split(input_blocks, vm["active-bits"].as<std::string>(),
                boost::is_any_of(";"));
@@ -350,78 +657,97 @@ int main(int argc, char** argv) try {
     }
   }
 
-  auto [var_names, lp_content] = modeller.finalize();
+  auto& milp = modeller.finalize(objective == "unit");
+  std::println("S-box inequalities computed: {}, reused: {}",
+               inequalities.computedSize(), inequalities.reusedSize());
+  if (vm.count("inequality-cache") && inequalities.computedSize() > 0) {
+    inequalities.save(vm["inequality-cache"].as<std::string>());
+  }
+
+  auto output_vars = modeller.getOutputs();
+  std::vector<bonc::ModelledValue> output_list(output_vars.begin(),
+                                               output_vars.end());
+  if (!vm.count("no-presolve")) {
+    auto stats = milp.presolve(output_list);
+    std::println("Presolve: variables {} -> {}, constraints {} -> {}, "
+                 "fixed: {}",
+                 stats.variables_before, stats.variables_after,
+                 stats.constraints_before, stats.constraints_after,
+                 stats.fixed);
+  } else {
+    std::println("Model variables: {}, constraints: {}", milp.variableSize(),
+                 milp.constraintSize());
+  }
+
+  auto output_columns = output_list
+                      | std::views::transform([&](bonc::ModelledValue var) {
+                          return milp.column(var);
+                        })
+                      | std::ranges::to<std::vector>();
 
-  std::println("Modelling time: {}, peak mem: {}kB",
+  std::println("Modelling time: {}, model memory: {}kB, peak mem: {}kB",
                timer.elapsed_as<std::chrono::milliseconds>(),
+               milp.memoryUsage() / 1024,
                bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
 
-  std::string output_file = vm["output"].as<std::string>();
-  {
-    std::ofstream ofs(output_file);
-    ofs << lp_content;
+  std::optional<std::string> output_file;
+  if (vm.count("output")) {
+    output_file = vm["output"].as<std::string>();
+  } else if (build == "lp") {
+    output_file = "output.lp";
+  }
+  if (output_file) {
+    timer.reset();
+    std::ofstream ofs(*output_file);
+    milp.writeLp(ofs);
+    ofs.close();
+    std::println("LP write time: {}",
+                 timer.elapsed_as<std::chrono::milliseconds>());
   }
 
-  GRBEnv env;
-  env.set(GRB_IntParam_OutputFlag, 0);
-  GRBModel model(env, output_file);
-
-  std::println("Model variables: {}, constraints: {}",
-               model.get(GRB_IntAttr_NumVars),
-               model.get(GRB_IntAttr_NumConstrs));
-  timer.reset();
-  int solve_count = 0;
-
-  std::unordered_set<std::string> balanced;
-  auto output_vars = modeller.getOutputs();
-  bool success = false;
-  while (balanced.size() < output_vars.size()) {
-    model.optimize();
-    solve_count++;
-    if (model.get(GRB_IntAttr_Status) == GRB_OPTIMAL) {
-      auto obj = model.getObjective();
-      if (model.get(GRB_DoubleAttr_ObjVal) > 1) {
-        success = true;
-        break;
-      } else {
-        std::cout << "COUNTER = " << balanced.size() << "\n";
-        for (auto& v : output_vars) {
-          auto name = var_names.at(v);
-          auto u = model.getVarByName(name);
-          auto temp = u.get(GRB_DoubleAttr_X);
-          if (std::abs(temp - 1) < 1e-6) {
-            balanced.insert(name);
-            u.set(GRB_DoubleAttr_UB, 0);
-            model.update();
-            break;
-          }
-        }
-      }
-    } else if (model.get(GRB_IntAttr_Status) == GRB_INFEASIBLE) {
-      success = true;
-      break;
-    } else {
-      throw std::runtime_error("Unknown error!");
-    }
+  if (engine == "sat" || engine == "both") {
+    searchDistinguisherSAT(milp, inequalities, output_list);
   }
-  if (success) {
-    std::println("Distinguisher found!");
-    for (auto& v : balanced) {
-      std::print("{} ", v);
+  if (engine == "sat") {
+    return 0;
+  }
+  auto workers = vm["workers"].as<std::size_t>();
+  for (auto& solver_name : solver_names) {
+    SolverSetup setup{solver_name, vm["solver-threads"].as<std::size_t>(),
+                      vm["pool-solutions"].as<std::size_t>(),
+                      build == "lp" ? output_file : std::nullopt};
+    UnitSearch result;
+    timer.reset();
+    if (workers > 1) {
+      result =
+          searchUnitOutputsSharded(setup, milp, output_columns, workers);
+    } else {
+      auto solver = setup.create(milp);
+      std::println("{} model build time: {}, peak mem: {}kB", solver_name,
+                   timer.elapsed_as<std::chrono::milliseconds>(),
+                   bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
+      std::println("Model variables: {}, constraints: {}",
+                   solver->variableSize(), solver->constraintSize());
+      timer.reset();
+      result = searchUnitOutputs(*solver, output_columns, output_columns);
     }
-    std::println("");
-  } else {
-    std::println("No distinguisher found.");
+    reportDistinguisher(result.reachable, output_list.size());
+    std::println("Solving {} models for {} unit outputs with {} in {} "
+                 "workers, time: {}, peak mem: {}kB",
+                 result.solves, result.reachable.size(), solver_name,
+                 std::max(workers, 1uz),
+                 timer.elapsed_as<std::chrono::milliseconds>(),
+                 bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
   }
-  std::println("Solving {} models, time: {}, peak mem: {}kB",
-               solve_count,
-               timer.elapsed_as<std::chrono::milliseconds>(),
-               bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
-} catch (const GRBException& e) {
+}
+#ifdef USE_GUROBI
+catch (const GRBException& e) {
   std::cerr << "Gurobi Error code = " << e.getErrorCode() << std::endl;
   std::cerr << e.getMessage() << std::endl;
   return 1;
-} catch (const std::exception& e) {
+}
+#endif
+catch (const std::exception& e) {
   std::cerr << "Error: " << e.what() << std::endl;
   return 1;
 }
\ No newline at end of file
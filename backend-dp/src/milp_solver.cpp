@@ -0,0 +1,257 @@
+#include "milp_solver.h"
+
+#include <algorithm>
+#include <format>
+#include <optional>
+#include <stdexcept>
+
+#ifdef USE_GUROBI
+#include "gurobi-model.hpp"
+#endif
+
+#ifdef USE_HIGHS
+#include <Highs.h>
+#endif
+
+namespace bonc::dp {
+
+namespace {
+
+#ifdef USE_GUROBI
+
+class GurobiSolver : public MILPSolver {
+private:
+  GRBEnv env;
+  std::optional<GRBModel> model;
+  std::optional<GurobiModelBuilder> builder;
+  std::size_t threads{0};
+  std::size_t pool_size{1};
+
+  GRBVar variable(std::size_t column) {
+    if (builder) {
+      return builder->variable(column);
+    }
+    // read from a file, where only the names tell the variables apart
+    return model->getVarByName(std::format("x{}", column));
+  }
+
+public:
+  GurobiSolver() {
+    env.set(GRB_IntParam_OutputFlag, 0);
+  }
+
+  std::string_view name() const override {
+    return "gurobi";
+  }
+
+  void load(const DeferredMILPModel& milp) override {
+    model.emplace(env);
+    builder.emplace(*model);
+    builder->build(milp);
+  }
+  void read(const std::string& path) override {
+    builder.reset();
+    model.emplace(env, path);
+  }
+
+  std::size_t variableSize() override {
+    return model->get(GRB_IntAttr_NumVars);
+  }
+  std::size_t constraintSize() override {
+    return model->get(GRB_IntAttr_NumConstrs);
+  }
+
+  void setThreads(std::size_t count) override {
+    threads = count;
+  }
+  void setSolutionPool(std::size_t size) override {
+    pool_size = std::max(size, 1uz);
+  }
+
+  Status optimize() override {
+    // parameters belong to the model, which `load` and `read` replace
+    model->set(GRB_IntParam_Threads, static_cast<int>(threads));
+    model->set(GRB_IntParam_PoolSolutions, static_cast<int>(pool_size));
+    // past the optimum, keep looking for other solutions to fill the pool
+    model->set(GRB_IntParam_PoolSearchMode, pool_size > 1 ? 2 : 0);
+    model->optimize();
+    switch (model->get(GRB_IntAttr_Status)) {
+      case GRB_OPTIMAL: return Status::Optimal;
+      case GRB_INFEASIBLE: return Status::Infeasible;
+      default: return Status::Other;
+    }
+  }
+  double objectiveValue() override {
+    return model->get(GRB_DoubleAttr_ObjVal);
+  }
+  std::size_t solutionCount() override {
+    return model->get(GRB_IntAttr_SolCount);
+  }
+  double value(std::size_t column, std::size_t solution) override {
+    if (solution == 0) {
+      return variable(column).get(GRB_DoubleAttr_X);
+    }
+    model->set(GRB_IntParam_SolutionNumber, static_cast<int>(solution));
+    return variable(column).get(GRB_DoubleAttr_Xn);
+  }
+  void setUpperBound(std::size_t column, double bound) override {
+    variable(column).set(GRB_DoubleAttr_UB, bound);
+    model->update();
+  }
+};
+
+#endif
+
+#ifdef USE_HIGHS
+
+class HighsSolver : public MILPSolver {
+private:
+  Highs highs;
+  // HiGHS columns are the model columns, unless read from a file, where
+  // they are in order of appearance
+  bool by_index{false};
+
+  HighsInt highsColumn(std::size_t column) {
+    if (by_index) {
+      return static_cast<HighsInt>(column);
+    }
+    HighsInt col;
+    if (highs.getColByName(std::format("x{}", column), col)
+        != HighsStatus::kOk) {
+      throw std::runtime_error(std::format("HiGHS: no column x{}", column));
+    }
+    return col;
+  }
+
+  static void check(HighsStatus status, std::string_view what) {
+    if (status == HighsStatus::kError) {
+      throw std::runtime_error(std::format("HiGHS: failed to {}", what));
+    }
+  }
+
+public:
+  HighsSolver() {
+    highs.setOptionValue("output_flag", false);
+  }
+
+  std::string_view name() const override {
+    return "highs";
+  }
+
+  /**
+   * The rows are already in row-wise compressed form, which HiGHS takes as
+   * is, converted to its index type.
+   */
+  void load(const DeferredMILPModel& milp) override {
+    HighsLp lp;
+    auto cols = milp.variableSize();
+    lp.num_col_ = static_cast<HighsInt>(cols);
+    lp.col_cost_.assign(cols, 0);
+    lp.col_lower_.assign(cols, 0);
+    lp.col_upper_.assign(cols, milp.binary() ? 1 : kHighsInf);
+    if (milp.binary()) {
+      lp.integrality_.assign(cols, HighsVarType::kInteger);
+    }
+    auto& rows = milp.getRows();
+    auto& matrix = lp.a_matrix_;
+    matrix.format_ = MatrixFormat::kRowwise;
+    matrix.start_.assign(rows.starts.begin(), rows.starts.end());
+    matrix.index_.assign(rows.columns.begin(), rows.columns.end());
+    matrix.value_ = rows.coefficients;
+    for (auto i = 0uz; i < rows.size(); i++) {
+      auto comparator = rows.comparators[i];
+      auto bound = rows.rhs[i];
+      lp.row_lower_.push_back(comparator == Comparator::LessEqual ? -kHighsInf
+                                                                  : bound);
+      lp.row_upper_.push_back(
+          comparator == Comparator::GreaterEqual ? kHighsInf : bound);
+    }
+    lp.num_row_ = static_cast<HighsInt>(rows.size());
+    matrix.num_col_ = lp.num_col_;
+    matrix.num_row_ = lp.num_row_;
+    if (auto& objective = milp.getObjective()) {
+      auto& [columns, coefficients, constant, maximize] = *objective;
+      for (auto k = 0uz; k < columns.size(); k++) {
+        lp.col_cost_[columns[k]] += coefficients[k];
+      }
+      lp.offset_ = constant;
+      lp.sense_ = maximize ? ObjSense::kMaximize : ObjSense::kMinimize;
+    }
+    check(highs.passModel(std::move(lp)), "pass the model");
+    by_index = true;
+  }
+  void read(const std::string& path) override {
+    check(highs.readModel(path), std::format("read {}", path));
+    by_index = false;
+  }
+
+  std::size_t variableSize() override {
+    return highs.getNumCol();
+  }
+  std::size_t constraintSize() override {
+    return highs.getNumRow();
+  }
+
+  void setThreads(std::size_t count) override {
+    if (count > 0) {
+      highs.setOptionValue("threads", static_cast<HighsInt>(count));
+    }
+  }
+  // HiGHS only reports its incumbent
+  void setSolutionPool(std::size_t) override {}
+
+  Status optimize() override {
+    check(highs.run(), "solve");
+    switch (highs.getModelStatus()) {
+      case HighsModelStatus::kOptimal: return Status::Optimal;
+      case HighsModelStatus::kInfeasible: return Status::Infeasible;
+      default: return Status::Other;
+    }
+  }
+  double objectiveValue() override {
+    return highs.getInfo().objective_function_value;
+  }
+  std::size_t solutionCount() override {
+    return highs.getSolution().value_valid ? 1 : 0;
+  }
+  double value(std::size_t column, std::size_t) override {
+    return highs.getSolution().col_value.at(highsColumn(column));
+  }
+  void setUpperBound(std::size_t column, double bound) override {
+    auto col = highsColumn(column);
+    check(highs.changeColBounds(col, highs.getLp().col_lower_[col], bound),
+          "change a bound");
+  }
+};
+
+#endif
+
+}  // namespace
+
+std::vector<std::string_view> availableMILPSolvers() {
+  std::vector<std::string_view> names;
+#ifdef USE_GUROBI
+  names.push_back("gurobi");
+#endif
+#ifdef USE_HIGHS
+  names.push_back("highs");
+#endif
+  return names;
+}
+
+std::unique_ptr<MILPSolver> createMILPSolver(std::string_view name) {
+#ifdef USE_GUROBI
+  if (name == "gurobi") {
+    return std::make_unique<GurobiSolver>();
+  }
+#endif
+#ifdef USE_HIGHS
+  if (name == "highs") {
+    return std::make_unique<HighsSolver>();
+  }
+#endif
+  throw std::runtime_error(
+      std::format("MILP solver {} is unknown or not enabled", name));
+}
+
+}  // namespace bonc::dp
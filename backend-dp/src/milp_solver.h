@@ -0,0 +1,83 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "deferred-milp-model.hpp"
+
+namespace bonc {
+
+namespace dp {
+
+/**
+ * @brief A MILP solver holding one model, with just what the balanced bit
+ * search needs: solve, read the solution, and tighten variable bounds.
+ *
+ * Queries are not const, as solver APIs build lookup tables lazily.
+ */
+class MILPSolver {
+public:
+  enum class Status {
+    Optimal,
+    Infeasible,
+    Other,
+  };
+
+  virtual ~MILPSolver() = default;
+
+  virtual std::string_view name() const = 0;
+
+  /**
+   * @brief Build the model from the complete `milp` through the solver API.
+   */
+  virtual void load(const DeferredMILPModel& milp) = 0;
+  /**
+   * @brief Read the model from a file written by
+   * `DeferredMILPModel::writeLp`.
+   */
+  virtual void read(const std::string& path) = 0;
+
+  virtual std::size_t variableSize() = 0;
+  virtual std::size_t constraintSize() = 0;
+
+  /**
+   * @brief Threads of each `optimize`, 0 for the solver default.
+   */
+  virtual void setThreads(std::size_t threads) = 0;
+  /**
+   * @brief Keep up to `size` solutions per `optimize`, searching for more
+   * than the optimum if the solver can.
+   */
+  virtual void setSolutionPool(std::size_t size) = 0;
+
+  virtual Status optimize() = 0;
+  /**
+   * @brief Of the last `optimize`, if it returned `Status::Optimal`.
+   */
+  virtual double objectiveValue() = 0;
+  /**
+   * @brief Solutions kept by the last `optimize`, the optimal one first.
+   */
+  virtual std::size_t solutionCount() = 0;
+  /**
+   * @param column `DeferredMILPModel::column` of a variable
+   */
+  virtual double value(std::size_t column, std::size_t solution = 0) = 0;
+  virtual void setUpperBound(std::size_t column, double bound) = 0;
+};
+
+/**
+ * @brief Names accepted by `createMILPSolver` in this build.
+ */
+std::vector<std::string_view> availableMILPSolvers();
+
+/**
+ * @throw std::runtime_error If `name` is unknown or was not built
+ */
+std::unique_ptr<MILPSolver> createMILPSolver(std::string_view name);
+
+}  // namespace dp
+
+}  // namespace bonc
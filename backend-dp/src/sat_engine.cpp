@@ -0,0 +1,189 @@
+#include "sat_engine.h"
+
+#include <stdexcept>
+
+#ifdef USE_CRYPTOMINISAT5
+
+#include <cmsat_adapter.hpp>
+#include <espresso_pool.h>
+#include <sat_modeller.h>
+
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+
+namespace bonc::dp {
+
+using namespace bonc::sat_modeller;
+
+struct SATDivisionChecker::Impl {
+  const MILPModel& milp;
+  CMSat::SATSolver solver;
+  CMSatClauseSink sink{solver};
+  SATModel model{sink};
+  std::vector<Variable> vars;
+  std::unordered_map<const LookupTable*, TableTemplate> templates;
+
+  Variable var(ModelledValue var) const {
+    return vars[var.id];
+  }
+  Variable var(DeferredModelledValue var) const {
+    return vars[milp.target(var).id];
+  }
+
+  /**
+   * @brief `result = lhs + rhs` over the integers, all binary.
+   */
+  void addSum(Variable lhs, Variable rhs, Variable result) {
+    model.addClause({result, -lhs});
+    model.addClause({result, -rhs});
+    model.addClause({-result, lhs, rhs});
+    model.addClause({-lhs, -rhs});
+  }
+
+  /**
+   * @brief `from = to[0] + ... + to[k]` over the integers, all binary: `from`
+   * is their OR, and at most one is set.
+   */
+  void addCopy(Variable from, const std::vector<ModelledValue>& to) {
+    std::vector<Variable> branches;
+    std::vector<Literal> any{-from};
+    for (auto branch : to) {
+      branches.push_back(var(branch));
+      any.push_back(branches.back());
+      model.addClause({from, -branches.back()});
+    }
+    model.addClause(any);
+    if (branches.size() <= 5) {
+      for (auto i = 0uz; i < branches.size(); i++) {
+        for (auto j = i + 1; j < branches.size(); j++) {
+          model.addClause({-branches[i], -branches[j]});
+        }
+      }
+    } else {
+      model.addSequentialCounterLessEqualClause(branches, 1);
+    }
+  }
+
+  const TableTemplate& trailTemplate(const Ref<LookupTable>& table,
+                                     InequalityCache& inequalities) {
+    if (auto it = templates.find(table.get()); it != templates.end()) {
+      return it->second;
+    }
+    auto& trails = inequalities.get(table).trails;
+    // trail coordinate `i` is bit `i`, inputs first like the variables
+    EspressoCover cover{trails.front().dimension(), {}};
+    for (auto& trail : trails) {
+      std::uint64_t minterm = 0;
+      for (auto i = 0uz; i < cover.width; i++) {
+        minterm |= std::uint64_t(trail.at(i) != 0) << i;
+      }
+      cover.minterms.push_back(minterm);
+    }
+    return templates
+        .emplace(table.get(), SATModel::buildTableTemplate(cover))
+        .first->second;
+  }
+
+  Impl(const MILPModel& milp, InequalityCache& inequalities) : milp{milp} {
+    // variables removed by `presolve` still take part in the operations
+    vars = model.createVariables(milp.allVariableSize(), "x");
+    std::vector<Literal> clause;
+    for (auto& operation : milp.getOperations()) {
+      std::visit(
+          [&]<typename T>(const T& op) {
+            if constexpr (std::is_same_v<T, operation::Constant>) {
+              model.addClause({op.value ? var(op.var) : -var(op.var)});
+            } else if constexpr (std::is_same_v<T, operation::Copy>) {
+              addCopy(var(op.from), op.to);
+            } else if constexpr (std::is_same_v<T, operation::Xor>) {
+              addSum(var(op.lhs), var(op.rhs), var(op.result));
+            } else if constexpr (std::is_same_v<T, operation::And>) {
+              // result >= lhs, result >= rhs, result <= lhs + rhs
+              model.addClause({var(op.result), -var(op.lhs)});
+              model.addClause({var(op.result), -var(op.rhs)});
+              model.addClause({-var(op.result), var(op.lhs), var(op.rhs)});
+            } else {
+              for (auto& row : trailTemplate(op.table, inequalities)) {
+                clause.clear();
+                for (auto i = 0uz; i < row.size(); i++) {
+                  if (row[i] == TableTemplate::Positive) {
+                    clause.push_back(var(op.vars.at(i)));
+                  } else if (row[i] == TableTemplate::Negative) {
+                    clause.push_back(-var(op.vars.at(i)));
+                  }
+                }
+                model.addClause(clause);
+              }
+            }
+          },
+          operation);
+    }
+    model.finish();
+  }
+};
+
+SATDivisionChecker::SATDivisionChecker(const MILPModel& milp,
+                                       InequalityCache& inequalities)
+    : impl{std::make_unique<Impl>(milp, inequalities)} {}
+
+SATDivisionChecker::~SATDivisionChecker() = default;
+
+std::size_t SATDivisionChecker::variableSize() const {
+  return impl->model.variableSize();
+}
+
+std::size_t SATDivisionChecker::clauseSize() const {
+  return impl->model.clauseSize();
+}
+
+std::size_t SATDivisionChecker::templateSize() const {
+  return impl->templates.size();
+}
+
+bool SATDivisionChecker::unitReachable(
+    ModelledValue output, std::span<const ModelledValue> outputs) {
+  std::vector<Literal> assumptions;
+  assumptions.reserve(outputs.size());
+  for (auto candidate : outputs) {
+    assumptions.push_back(candidate == output ? impl->var(candidate)
+                                              : -impl->var(candidate));
+  }
+  return bonc::solve(impl->solver, assumptions).has_value();
+}
+
+}  // namespace bonc::dp
+
+#else
+
+namespace bonc::dp {
+
+struct SATDivisionChecker::Impl {};
+
+SATDivisionChecker::SATDivisionChecker(const MILPModel&, InequalityCache&) {
+  throw std::runtime_error("cryptominisat5 is not enabled");
+}
+
+SATDivisionChecker::~SATDivisionChecker() = default;
+
+std::size_t SATDivisionChecker::variableSize() const {
+  return 0;
+}
+
+std::size_t SATDivisionChecker::clauseSize() const {
+  return 0;
+}
+
+std::size_t SATDivisionChecker::templateSize() const {
+  return 0;
+}
+
+bool SATDivisionChecker::unitReachable(ModelledValue,
+                                       std::span<const ModelledValue>) {
+  return true;
+}
+
+}  // namespace bonc::dp
+
+#endif
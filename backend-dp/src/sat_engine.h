@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <span>
+
+#include "dp-milp-model.hpp"
+#include "inequality_cache.h"
+
+namespace bonc {
+
+namespace dp {
+
+/**
+ * @brief Division trails of a `MILPModel` as CNF in one incremental
+ * CryptoMiniSat instance.
+ *
+ * Copy, XOR and AND get their exact clauses; each S-box the clauses espresso
+ * minimises from its trail vertices, once per table. Outputs are then
+ * checked one by one under assumptions, sharing the learnt clauses.
+ */
+class SATDivisionChecker {
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+
+public:
+  /**
+   * @param inequalities Source of the S-box trails
+   * @throw std::runtime_error Without cryptominisat5
+   */
+  SATDivisionChecker(const MILPModel& milp, InequalityCache& inequalities);
+  ~SATDivisionChecker();
+
+  std::size_t variableSize() const;
+  std::size_t clauseSize() const;
+  /**
+   * @brief Distinct S-box tables minimised by espresso.
+   */
+  std::size_t templateSize() const;
+
+  /**
+   * @brief Whether some trail ends in the unit vector of `output` among
+   * `outputs`, i.e. the bit is not proven balanced.
+   */
+  bool unitReachable(ModelledValue output,
+                     std::span<const ModelledValue> outputs);
+};
+
+}  // namespace dp
+
+}  // namespace bonc
@@ -1,24 +1,21 @@
 #include "sbox_modelling.h"
 
+#include <algorithm>
+#include <bit>
 #include <boost/dynamic_bitset.hpp>
+#include <condition_variable>
 #include <cstdint>
+#include <mutex>
 #include <ranges>
+#include <set>
 #include <stdexcept>
-#include <unordered_set>
+#include <thread>
 
-namespace {
+#ifdef USE_CRYPTOMINISAT5
+#include <cmsat_adapter.hpp>
+#endif
 
-int evaluateInequality(const PolyhedronVertex& point,
-                       const PolyhedronInequality& inequality) {
-  if (point.dimension() != inequality.dimension()) {
-    throw std::invalid_argument("Point dimension and inequality size mismatch");
-  }
-  int sum = inequality.constant_term;
-  for (auto i = 0uz; i < point.dimension(); ++i) {
-    sum += point.at(i) * inequality.coefficients.at(i);
-  }
-  return sum;
-}
+namespace {
 
 constexpr bool isPowerOfTwo(std::uint64_t n) {
   return std::popcount(n) == 1;
@@ -35,11 +32,41 @@ constexpr std::uint64_t bitPower(std::uint64_t x, std::uint64_t u) {
   return (x & u) == u;
 }
 
+constexpr std::size_t wordOf(std::size_t point) {
+  return point / 64;
+}
+
+constexpr std::uint64_t bitOf(std::size_t point) {
+  return std::uint64_t{1} << point % 64;
+}
+
 }  // namespace
 
-std::vector<PolyhedronInequality> reduceInequalities(
-    const std::vector<PolyhedronInequality>& inequalities,
-    const std::vector<PolyhedronVertex>& points) {
+namespace {
+
+/**
+ * @brief Points to cut off and the ones each inequality does, as bitsets of
+ * `{0,1}^n`.
+ */
+struct CutOffPoints {
+  std::size_t words;
+  // points outside the given ones
+  std::vector<std::uint64_t> complement;
+  // per inequality, only those of `complement`
+  std::vector<std::vector<std::uint64_t>> violations;
+};
+
+std::size_t popcount(const std::vector<std::uint64_t>& bits) {
+  auto count = 0uz;
+  for (auto word : bits) {
+    count += std::popcount(word);
+  }
+  return count;
+}
+
+CutOffPoints cutOffPoints(const std::vector<PolyhedronInequality>& inequalities,
+                          const std::vector<PolyhedronVertex>& points,
+                          std::size_t threads) {
   if (points.empty() || inequalities.empty()) {
     throw std::invalid_argument("Points and inequalities must not be empty");
   }
@@ -54,71 +81,228 @@ std::vector<PolyhedronInequality> reduceInequalities(
       throw std::invalid_argument("Inequality size must equal dimension");
     }
   }
+  if (dimension >= 32) {
+    throw std::invalid_argument("Dimension too large to enumerate points");
+  }
+
+  // point `p` of {0,1}^dimension has coordinate `i` as bit `i`, and is bit
+  // `p` of a bitset
+  const std::size_t total_points = 1uz << dimension;
+  CutOffPoints cut{(total_points + 63) / 64, {}, {}};
+  const auto words = cut.words;
 
-  std::unordered_set<PolyhedronVertex> point_set;
-  point_set.reserve(points.size());
+  auto& complement = cut.complement;
+  complement.assign(words, ~std::uint64_t{0});
+  if (total_points % 64 != 0) {
+    complement.back() = bitOf(total_points) - 1;
+  }
   for (const auto& p : points) {
-    point_set.insert(p);
+    std::size_t point = 0;
+    for (auto i = 0uz; i < dimension; i++) {
+      point |= std::size_t(p.at(i) != 0) << i;
+    }
+    complement[wordOf(point)] &= ~bitOf(point);
+  }
+
+  // The value at `p` is the value at `p` without its lowest bit plus that
+  // coefficient, so a table costs one addition per point.
+  auto& violations = cut.violations;
+  violations.resize(inequalities.size());
+  auto score = [&](std::size_t first, std::size_t last) {
+    std::vector<int> values(total_points);
+    for (auto idx = first; idx < last; idx++) {
+      const auto& ineq = inequalities[idx];
+      auto& violated = violations[idx];
+      violated.assign(words, 0);
+      values[0] = ineq.constant_term;
+      for (auto point = 1uz; point < total_points; point++) {
+        values[point] = values[point & (point - 1)]
+                      + ineq.coefficients[std::countr_zero(point)];
+      }
+      for (auto point = 0uz; point < total_points; point++) {
+        if (values[point] < 0) {
+          violated[wordOf(point)] |= bitOf(point);
+        }
+      }
+      for (auto word = 0uz; word < words; word++) {
+        violated[word] &= complement[word];
+      }
+    }
+  };
+  threads = std::clamp<std::size_t>(threads, 1, inequalities.size());
+  if (threads == 1) {
+    score(0, inequalities.size());
+  } else {
+    std::vector<std::jthread> workers;
+    for (auto t = 0uz; t < threads; t++) {
+      workers.emplace_back(score, inequalities.size() * t / threads,
+                           inequalities.size() * (t + 1) / threads);
+    }
+  }
+  return cut;
+}
+
+/**
+ * @brief Indices of the inequalities chosen by 'Algorithm 1'.
+ */
+std::vector<std::size_t> greedyCover(CutOffPoints cut) {
+  const auto words = cut.words;
+  auto& violations = cut.violations;
+  // inequalities which may still cut something off, in input order so
+  // ties go to the first one as before
+  std::vector<std::size_t> candidates;
+  std::vector<std::size_t> counts(violations.size());
+  for (auto idx = 0uz; idx < violations.size(); idx++) {
+    if ((counts[idx] = popcount(violations[idx])) != 0) {
+      candidates.push_back(idx);
+    }
   }
 
-  const std::size_t total_points = 1ull << dimension;
-  std::vector<PolyhedronVertex> complement;
-  complement.reserve(total_points - points.size());
-  for (auto idx = 0uz; idx < total_points; idx++) {
-    auto candidate = PolyhedronVertex::fromIntBits(idx, dimension);
-    if (!point_set.count(candidate)) {
-      complement.push_back(std::move(candidate));
+  std::vector<std::size_t> result;
+  auto left = popcount(cut.complement);
+  while (left != 0) {
+    if (candidates.empty()) {
+      throw std::runtime_error(
+          "Failed to reduce inequalities: insufficient separating power");
     }
+    auto best = *std::ranges::max_element(
+        candidates, [&](auto a, auto b) { return counts[a] < counts[b]; });
+    result.push_back(best);
+    left -= counts[best];
+    auto chosen = std::move(violations[best]);
+    // the points it cuts off no longer count for the others
+    std::erase(candidates, best);
+    std::erase_if(candidates, [&](std::size_t idx) {
+      auto& violated = violations[idx];
+      for (auto word = 0uz; word < words; word++) {
+        violated[word] &= ~chosen[word];
+      }
+      counts[idx] = popcount(violated);
+      if (counts[idx] == 0) {
+        violated = {};
+        return true;
+      }
+      return false;
+    });
   }
+  return result;
+}
+
+std::vector<PolyhedronInequality> pick(
+    const std::vector<PolyhedronInequality>& inequalities,
+    const std::vector<std::size_t>& indices) {
+  return indices
+       | std::views::transform([&](auto idx) { return inequalities[idx]; })
+       | std::ranges::to<std::vector>();
+}
 
-  std::vector<PolyhedronInequality> remaining = inequalities;
-  std::vector<PolyhedronInequality> result;
-  result.reserve(remaining.size());
+}  // namespace
 
-  while (!complement.empty()) {
-    auto best_index = remaining.size();
-    std::vector<std::size_t> violates_indices;
+std::vector<PolyhedronInequality> reduceInequalities(
+    const std::vector<PolyhedronInequality>& inequalities,
+    const std::vector<PolyhedronVertex>& points, std::size_t threads) {
+  return pick(inequalities,
+              greedyCover(cutOffPoints(inequalities, points, threads)));
+}
 
-    for (std::size_t idx = 0; idx < remaining.size(); ++idx) {
-      std::vector<std::size_t> current_violation_indices;
-      for (std::size_t pt_idx = 0; pt_idx < complement.size(); ++pt_idx) {
-        if (evaluateInequality(complement[pt_idx], remaining[idx]) < 0) {
-          current_violation_indices.push_back(pt_idx);
+#ifdef USE_CRYPTOMINISAT5
+
+std::vector<PolyhedronInequality> minimizeInequalities(
+    const std::vector<PolyhedronInequality>& inequalities,
+    const std::vector<PolyhedronVertex>& points,
+    std::chrono::milliseconds time_limit, std::size_t threads) {
+  using namespace bonc::sat_modeller;
+  using Clock = std::chrono::steady_clock;
+  auto deadline = Clock::now() + time_limit;
+  auto cut = cutOffPoints(inequalities, points, threads);
+  auto best = greedyCover(cut);
+  if (best.size() <= 1) {
+    return pick(inequalities, best);
+  }
+
+  std::vector<std::size_t> candidates;
+  for (auto idx = 0uz; idx < inequalities.size(); idx++) {
+    if (popcount(cut.violations[idx]) != 0) {
+      candidates.push_back(idx);
+    }
+  }
+  // One clause per point to cut off, over the candidates doing so. Points
+  // cut off by the same candidates share it.
+  std::set<std::vector<std::size_t>> clauses;
+  std::vector<std::size_t> covering;
+  for (auto word = 0uz; word < cut.words; word++) {
+    for (auto bits = cut.complement[word]; bits != 0; bits &= bits - 1) {
+      auto bit = std::uint64_t{1} << std::countr_zero(bits);
+      covering.clear();
+      for (auto c = 0uz; c < candidates.size(); c++) {
+        if (cut.violations[candidates[c]][word] & bit) {
+          covering.push_back(c);
         }
       }
-      if (current_violation_indices.size() > violates_indices.size()) {
-        best_index = idx;
-        violates_indices = std::move(current_violation_indices);
-      }
+      clauses.insert(covering);
     }
+  }
 
-    if (best_index == remaining.size() || violates_indices.empty()) {
-      throw std::runtime_error(
-          "Failed to reduce inequalities: insufficient separating power");
+  CMSat::SATSolver solver;
+  solver.set_num_threads(static_cast<unsigned>(std::max(threads, 1uz)));
+  bonc::CMSatClauseSink sink{solver};
+  SATModel model{sink};
+  auto chosen = model.createVariables(candidates.size(), "ineq");
+  std::vector<Literal> clause;
+  for (auto& covered_by : clauses) {
+    clause.clear();
+    for (auto c : covered_by) {
+      clause.push_back(chosen[c]);
     }
+    model.addClause(clause);
+  }
+  auto bound = model.addCardinalityLessEqual(chosen, best.size() - 1,
+                                             CardinalityEncoding::Totalizer);
+  model.finish();
 
-    PolyhedronInequality chosen = remaining[best_index];
-    result.push_back(chosen);
+  // CryptoMiniSat's own time limit counts CPU time of all its threads, so
+  // interrupt it at the wall-clock deadline instead. Keep interrupting past
+  // it, as a solve started just before may have cleared the request.
+  std::mutex mutex;
+  std::condition_variable_any stopped;
+  std::jthread timer{[&](std::stop_token stop) {
+    auto never = [] { return false; };
+    std::unique_lock lock{mutex};
+    stopped.wait_until(lock, stop, deadline, never);
+    while (!stop.stop_requested()) {
+      solver.interrupt_asap();
+      stopped.wait_for(lock, stop, std::chrono::milliseconds{100}, never);
+    }
+  }};
 
-    std::vector<PolyhedronVertex> filtered;
-    filtered.reserve(complement.size() - violates_indices.size());
-    boost::dynamic_bitset<> to_remove(complement.size());
-    for (std::size_t idx : violates_indices) {
-      to_remove.set(idx, true);
+  // tighten below the best cover found until none is left or time is up
+  while (best.size() > 1 && Clock::now() < deadline) {
+    auto values =
+        bonc::solve(solver, bound.assumeAtMost(model, best.size() - 1));
+    if (!values) {
+      break;
     }
-    for (std::size_t idx = 0; idx < complement.size(); ++idx) {
-      if (!to_remove.test(idx)) {
-        filtered.push_back(std::move(complement[idx]));
+    best.clear();
+    for (auto c = 0uz; c < candidates.size(); c++) {
+      if (values->at(chosen[c].getIndex()) == bonc::SolvedModelValue::True) {
+        best.push_back(candidates[c]);
       }
     }
-    complement = std::move(filtered);
-    remaining.erase(remaining.begin()
-                    + static_cast<std::ptrdiff_t>(best_index));
   }
+  return pick(inequalities, best);
+}
 
-  return result;
+#else
+
+std::vector<PolyhedronInequality> minimizeInequalities(
+    const std::vector<PolyhedronInequality>&,
+    const std::vector<PolyhedronVertex>&, std::chrono::milliseconds,
+    std::size_t) {
+  throw std::runtime_error("cryptominisat5 is not enabled");
 }
 
+#endif
+
 std::vector<PolyhedronVertex> divisionPropertyTrail(
     const bonc::Ref<bonc::LookupTable>& sbox) {
   auto input_width = sbox->getInputWidth();
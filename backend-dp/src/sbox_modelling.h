@@ -2,6 +2,7 @@
 
 #include <lookup_table.h>
 
+#include <chrono>
 #include <vector>
 
 #include "polyhedron.h"
@@ -16,13 +17,37 @@
  * @ref
  * https://github.com/xiangzejun/MILP_Division_Property/blob/master/algorithm1/reducelin.py
  *
+ * Points of `{0,1}^n` are packed as integers, and the points each inequality
+ * cuts off are a bitset computed once; every greedy step masks them with the
+ * choice and recounts.
+ *
  * @param inequalities
  * @param points
+ * @param threads Threads computing the bitsets
  * @return Reduced inequalities
  */
 std::vector<PolyhedronInequality> reduceInequalities(
     const std::vector<PolyhedronInequality>& inequalities,
-    const std::vector<PolyhedronVertex>& points);
+    const std::vector<PolyhedronVertex>& points, std::size_t threads = 1);
+
+/**
+ * @brief Reduce the set of inequalities to as few as possible while keeping
+ * all given points feasible.
+ *
+ * Solves the set cover of the points outside `points` exactly with
+ * CryptoMiniSat: one variable per inequality, one clause per point listing
+ * the inequalities cutting it off, and a totalizer bounding their count
+ * below the greedy result of `reduceInequalities`, tightened under
+ * assumptions until unsatisfiable.
+ *
+ * @param time_limit Stop with the smallest cover found so far once reached
+ * @param threads Threads computing the bitsets and solving
+ * @throw std::runtime_error Without cryptominisat5
+ */
+std::vector<PolyhedronInequality> minimizeInequalities(
+    const std::vector<PolyhedronInequality>& inequalities,
+    const std::vector<PolyhedronVertex>& points,
+    std::chrono::milliseconds time_limit, std::size_t threads = 1);
 
 /**
  * @brief Compute the division property trail of a given S-box.
@@ -28,7 +28,7 @@ public:
     return TraverseResult{type};
   }
   static TraverseResult makeModelled(ConstDeferredModelledValue modelled, MILPModel& model) {
-    auto mutable_value = model.createDeferredVariable(modelled->getVar());
+    auto mutable_value = model.createDeferredVariable(model.target(modelled));
     return TraverseResult{std::move(mutable_value)};
   }
 
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cmsat_adapter.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace bonc {
+
+/**
+ * @brief Trails sharing fixed input and output values, counted by weight.
+ */
+struct TrailHull {
+  std::map<std::size_t, std::size_t> trails;
+  /**
+   * @brief Whether enumeration stopped because no trail was left, not
+   * because of the trail limit.
+   */
+  bool complete{true};
+
+  void merge(const TrailHull& other) {
+    for (auto [weight, count] : other.trails) {
+      trails[weight] += count;
+    }
+    complete = complete && other.complete;
+  }
+
+  std::size_t size() const {
+    auto total = 0uz;
+    for (auto [weight, count] : trails) {
+      total += count;
+    }
+    return total;
+  }
+
+  /**
+   * @brief `log2(sum(count * 2^(-scale * weight)))`, computed relative to the
+   * minimum weight so no term underflows.
+   *
+   * @param scale 1 for differential probabilities, 2 for the squared
+   * correlations summed up by the expected linear potential.
+   */
+  double log2Probability(double scale = 1) const {
+    if (trails.empty()) {
+      return -std::numeric_limits<double>::infinity();
+    }
+    auto min_weight = trails.begin()->first;
+    auto sum = 0.0;
+    for (auto [weight, count] : trails) {
+      sum += double(count) * std::exp2(-scale * double(weight - min_weight));
+    }
+    return std::log2(sum) - scale * double(min_weight);
+  }
+};
+
+using TrailWeightFunction =
+    std::function<std::size_t(const std::vector<SolvedModelValue>&)>;
+
+/**
+ * @brief Enumerate solutions under `assumptions` which differ on
+ * `trail_vars`, blocking each one in `solver` once it is found.
+ *
+ * @param budget Trails left to enumerate, shared between workers.
+ */
+inline TrailHull enumerateTrails(
+    CMSat::SATSolver& solver,
+    std::span<const bonc::sat_modeller::Literal> assumptions,
+    std::span<const bonc::sat_modeller::Variable> trail_vars,
+    const TrailWeightFunction& weight, std::atomic<std::size_t>& budget) {
+  TrailHull hull;
+  std::vector<CMSat::Lit> blocking;
+  while (true) {
+    auto remaining = budget.load();
+    do {
+      if (remaining == 0) {
+        hull.complete = false;
+        return hull;
+      }
+    } while (!budget.compare_exchange_weak(remaining, remaining - 1));
+    auto values = solve(solver, assumptions);
+    if (!values) {
+      budget++;
+      return hull;
+    }
+    hull.trails[weight(*values)]++;
+    blocking.clear();
+    for (auto var : trail_vars) {
+      auto index = static_cast<uint32_t>(var.getIndex());
+      blocking.push_back(
+          CMSat::Lit{index, values->at(index) == SolvedModelValue::True});
+    }
+    solver.add_clause(blocking);
+  }
+}
+
+/**
+ * @brief `enumerateTrails` split into the `2^split_vars.size()` cubes of
+ * assignments to `split_vars`, which `threads` solvers take in turn.
+ *
+ * Every worker loads the CNF into its own solver once.
+ */
+inline TrailHull enumerateTrailsParallel(
+    const bonc::sat_modeller::ClauseArena& clauses,
+    const bonc::sat_modeller::XorArena& xors, std::size_t variable_count,
+    std::span<const bonc::sat_modeller::Literal> assumptions,
+    std::span<const bonc::sat_modeller::Variable> trail_vars,
+    std::span<const bonc::sat_modeller::Variable> split_vars,
+    std::size_t threads, const TrailWeightFunction& weight,
+    std::atomic<std::size_t>& budget) {
+  auto cubes = 1uz << split_vars.size();
+  std::atomic<std::size_t> next_cube{0};
+  std::mutex mutex;
+  TrailHull hull;
+  {
+    std::vector<std::jthread> workers;
+    for (auto i = 0uz; i < std::min(threads, cubes); i++) {
+      workers.emplace_back([&] {
+        CMSat::SATSolver solver;
+        load(solver, clauses, xors, variable_count);
+        TrailHull local;
+        std::vector<bonc::sat_modeller::Literal> cube_assumptions;
+        for (auto cube = next_cube++; cube < cubes; cube = next_cube++) {
+          cube_assumptions.assign(assumptions.begin(), assumptions.end());
+          for (auto bit = 0uz; bit < split_vars.size(); bit++) {
+            cube_assumptions.push_back((cube >> bit) & 1 ? split_vars[bit]
+                                                         : -split_vars[bit]);
+          }
+          local.merge(enumerateTrails(solver, cube_assumptions, trail_vars,
+                                      weight, budget));
+        }
+        std::lock_guard lock{mutex};
+        hull.merge(local);
+      });
+    }
+  }
+  return hull;
+}
+
+}  // namespace bonc
@@ -1,3 +1,4 @@
+#include <dimacs.h>
 #include <frontend_result_parser.h>
 #include <sat_modeller.h>
 #include <sbox_and_input.h>
@@ -6,26 +7,103 @@
 
 #include <boost/algorithm/string.hpp>
 #include <boost/regex.hpp>
+#include <bit>
 #include <fstream>
+#include <map>
+#include <numeric>
 #include <print>
+#include <random>
+#include <thread>
 
 #ifdef USE_CRYPTOMINISAT5
-#include "cmsat_adapter.hpp"
+#include <cmsat_adapter.hpp>
+#include "enumeration.hpp"
+#include "portfolio.hpp"
 #endif
+#include "sharded_memo.hpp"
+
+/**
+ * @brief Plan and shared state for building one model from several threads.
+ *
+ * Every shard traverses its own slice of the outputs into a thread-local
+ * model. An expression or S-box reached by several shards is modelled by the
+ * lowest of them, which publishes its variables; the others wait for them
+ * and refer to them through proxy variables, resolved when the shards are
+ * merged in order. Shards only wait for lower ones, so this cannot deadlock,
+ * and the merged CNF only depends on the number of shards.
+ */
+struct ModelShards {
+  static constexpr std::size_t UNPLANNED =
+      std::numeric_limits<std::size_t>::max();
+
+  struct Owner {
+    std::size_t shard{UNPLANNED};
+    bool shared{false};
+  };
+  struct ForeignVariable {
+    std::size_t shard;
+    bonc::sat_modeller::Variable var;
+    bool free;
+  };
+  struct ForeignBlock {
+    std::size_t shard;
+    std::vector<bonc::sat_modeller::Variable> outputs;
+  };
+
+  // by `BitExpr::getId()`
+  std::vector<Owner> expr_owners;
+  std::unordered_map<bonc::SBoxInputBlock, Owner> block_owners;
+  std::unordered_map<const bonc::LookupTable*,
+                     const bonc::sat_modeller::TableTemplate*>
+      templates;
+  bonc::ShardedMemo<const bonc::BitExpr*, ForeignVariable> exprs;
+  bonc::ShardedMemo<bonc::SBoxInputBlock, ForeignBlock> blocks;
+};
 
 class Modeller {
 public:
-  enum class ModellingType { DDT, LAT };
+  /**
+   * `ActiveDDT` and `ActiveLAT` are truncated models: a bit only tells whether
+   * its difference or mask is nonzero, and each active S-box costs the least
+   * weight of its table, which bounds the weight of bit-level trails from
+   * below.
+   */
+  enum class ModellingType { DDT, LAT, ActiveDDT, ActiveLAT };
 
   const ModellingType type;
   bonc::sat_modeller::SATModel model;
   const bonc::sat_modeller::Variable FALSE;
 
 private:
-  std::unordered_set<bonc::sat_modeller::Variable> weight_vars;
-  std::unordered_set<bonc::sat_modeller::Variable> input_vars;
-  std::unordered_set<bonc::sat_modeller::Variable> free_vars;
+  enum VariableKind : std::uint8_t { Weight = 1, Input = 2, Free = 4 };
+
+  std::vector<bonc::sat_modeller::Variable> weight_vars;
+  std::vector<bonc::sat_modeller::Variable> input_vars;
+  // `VariableKind` flags by variable index
+  std::vector<std::uint8_t> variable_kinds;
   std::unordered_set<std::string> input_names;
+  // S-box activities of the truncated models, with their least weight
+  std::vector<bonc::sat_modeller::WeightedVariable> sbox_activities;
+
+  bonc::sat_modeller::CardinalityEncoding cardinality_encoding{
+      bonc::sat_modeller::CardinalityEncoding::SequentialCounter};
+  std::optional<bonc::sat_modeller::CardinalityBound> weight_bound;
+
+  // Weight variables grouped by the iteration whose update expressions
+  // produce them; S-boxes reached from outputs directly come last.
+  std::unordered_map<const bonc::ReadTarget*, std::size_t> iteration_indices;
+  std::size_t current_iteration{0};
+  std::map<std::size_t, std::vector<bonc::sat_modeller::Variable>>
+      iteration_weight_vars;
+  std::map<std::size_t,
+           std::vector<std::vector<bonc::sat_modeller::Variable>>>
+      iteration_sbox_inputs;
+  bool round_bounds{false};
+  std::size_t weight_limit{0};
+  // Counter registers over weight variables ordered by round, and the
+  // register row closing each round.
+  std::vector<std::vector<bonc::sat_modeller::Variable>> round_counter;
+  std::vector<std::size_t> round_ends;
 
   bonc::Ref<bonc::LookupTable> AND_TABLE;
   bonc::Ref<bonc::LookupTable> OR_TABLE;
@@ -33,28 +111,158 @@ private:
   std::unordered_map<const bonc::LookupTable*,
                      std::unique_ptr<bonc::sat_modeller::TableTemplate>>
       known_templates;
-  std::unordered_map<const bonc::BitExpr*, bonc::sat_modeller::Variable>
-      modelled_exprs;
-  std::unordered_map<bonc::SBoxInputBlock,
-                     std::vector<bonc::sat_modeller::Variable>>
-      modelled_sbox_inputs;
+  // Variable index of each expression by `BitExpr::getId()`, 0 if it is not
+  // modelled yet, and the modelled expressions in order.
+  std::vector<std::uint32_t> expr_vars;
+  std::vector<const bonc::BitExpr*> modelled_nodes;
+  // Output variables of each modelled block start at its offset in
+  // `sbox_outputs`, one per output bit of its table.
+  std::unordered_map<bonc::SBoxInputBlock, std::size_t> modelled_sbox_inputs;
+  std::vector<bonc::sat_modeller::Variable> sbox_outputs;
+
+  // Set while this modeller builds one shard of a model
+  ModelShards* shards{nullptr};
+  std::size_t shard_index{0};
+  // proxies of variables owned by other shards, keyed by (shard, variable)
+  std::map<std::pair<std::size_t, std::size_t>, bonc::sat_modeller::Variable>
+      import_proxies;
+  std::vector<std::pair<bonc::sat_modeller::Variable,
+                        ModelShards::ForeignVariable>>
+      imports;
 
 public:
   explicit Modeller(ModellingType type)
       : type{type}, model{}, FALSE{model.createVariable("FALSE")} {
+    init();
+  }
+  Modeller(ModellingType type, bonc::sat_modeller::ClauseSink& sink)
+      : type{type}, model{sink}, FALSE{model.createVariable("FALSE")} {
+    init();
+  }
+
+private:
+  void init() {
     model.addClause({-FALSE});
-    AND_TABLE = bonc::LookupTable::create("AND", 2, 1, {0, 0, 0, 1});
-    OR_TABLE = bonc::LookupTable::create("OR", 2, 1, {0, 1, 1, 1});
+    // shared by all modellers, as S-box blocks of gates are keyed by them
+    static const auto and_table =
+        bonc::LookupTable::create("AND", 2, 1, {0, 0, 0, 1});
+    static const auto or_table =
+        bonc::LookupTable::create("OR", 2, 1, {0, 1, 1, 1});
+    AND_TABLE = and_table;
+    OR_TABLE = or_table;
+  }
+
+public:
+  bool differential() const {
+    return type == ModellingType::DDT || type == ModellingType::ActiveDDT;
+  }
+  bool truncated() const {
+    return type == ModellingType::ActiveDDT || type == ModellingType::ActiveLAT;
   }
 
   void addInputNames(std::span<std::string> names) {
     input_names.insert_range(names);
   }
 
+  /**
+   * @brief Iterations in execution order, used to group weight variables by
+   * round.
+   */
+  void setIterations(std::span<const bonc::Ref<bonc::ReadTarget>> iterations) {
+    for (auto i = 0uz; i < iterations.size(); i++) {
+      iteration_indices.emplace(iterations[i].get(), i);
+    }
+    current_iteration = iterations.size();
+  }
+
+  /**
+   * @brief Bound the weight with a sequential counter over weight variables
+   * ordered by round, whose registers give per-round prefix sums for
+   * Matsui-style bounds.
+   */
+  void enableRoundBounds() {
+    round_bounds = true;
+  }
+
+  /**
+   * @brief The weight bound asserted by `complete`.
+   */
+  std::size_t getWeightLimit() const {
+    return weight_limit;
+  }
+
+  /**
+   * @brief Number of rounds, i.e. iterations containing weight variables;
+   * available after `complete`.
+   */
+  std::size_t roundSize() const {
+    return round_ends.size();
+  }
+
+  /**
+   * @brief Assumptions for "weight of the first `rounds` rounds <= k".
+   */
+  std::vector<bonc::sat_modeller::Literal> assumeRoundsAtMost(
+      std::size_t rounds, std::size_t k) const {
+    assert(round_bounds && rounds >= 1 && rounds <= roundSize());
+    auto& registers = round_counter.at(round_ends.at(rounds - 1));
+    if (k >= registers.size()) {
+      return {};
+    }
+    return {-registers.at(k)};
+  }
+
+  /**
+   * @brief Matsui's bounding conditions for "weight of the first `rounds`
+   * rounds <= k", given the optimal weights `best[i]` of `i` rounds,
+   * `best[0] = 0`, for all `i < rounds`.
+   *
+   * Rounds `a..b` leave the trails over rounds `1..a-1` and `b+1..rounds`,
+   * which weigh at least `best[a-1]` and `best[rounds-b]`, hence
+   * `w(a..b) <= k - best[a-1] - best[rounds-b]`. The conditions are guarded
+   * by a fresh selector, which is returned as the assumption.
+   */
+  std::vector<bonc::sat_modeller::Literal> assumeMatsuiBounds(
+      std::size_t rounds, std::size_t k, std::span<const std::size_t> best) {
+    assert(round_bounds && rounds <= roundSize() && best.size() >= rounds);
+    auto selector =
+        model.createVariable(std::format("matsui_{}_{}", rounds, k));
+    auto prefix = [&](std::size_t round) -> auto& {
+      return round_counter.at(round_ends.at(round - 1));
+    };
+    for (auto a = 1uz; a <= rounds; a++) {
+      for (auto b = a; b <= rounds; b++) {
+        if (a == 1 && b == rounds) {
+          continue;
+        }
+        auto outside = best[a - 1] + best[rounds - b];
+        if (outside > k) {
+          model.addClause({-selector});
+          return {selector};
+        }
+        auto m = k - outside;
+        auto registers = prefix(b).size();
+        if (m >= registers) {
+          continue;
+        }
+        if (a == 1) {
+          model.addClause({-selector, -prefix(b).at(m)});
+          continue;
+        }
+        // prefix(b) >= t + m implies prefix(a - 1) >= t
+        for (auto t = 1uz; t + m <= registers; t++) {
+          model.addClause({-selector, -prefix(b).at(t + m - 1),
+                           prefix(a - 1).at(t - 1)});
+        }
+      }
+    }
+    return {selector};
+  }
+
   bonc::sat_modeller::Literal::ValueT getExprIndex(
-      bonc::Ref<bonc::BitExpr> expr) {
-    if (auto it = modelled_exprs.find(expr.get()); it != modelled_exprs.end()) {
-      return it->second.getIndex();
+      bonc::Ref<bonc::BitExpr> expr) const {
+    if (auto var = modelledVariable(expr.get())) {
+      return var->getIndex();
     } else {
       return -1;
     }
@@ -63,29 +271,136 @@ public:
   const auto& getWeightVars() const {
     return weight_vars;
   }
+  const auto& getInputVars() const {
+    return input_vars;
+  }
+
+  /**
+   * @brief Variables telling trails apart: modelled expressions and weights,
+   * but not free variables.
+   */
+  std::vector<bonc::sat_modeller::Variable> getTrailVariables() const {
+    auto result = weight_vars;
+    for (auto expr : modelled_nodes) {
+      if (auto var = *modelledVariable(expr); var != FALSE) {
+        result.push_back(var);
+      }
+    }
+    std::ranges::sort(result, {}, &bonc::sat_modeller::Variable::getIndex);
+    auto [first, last] = std::ranges::unique(result);
+    result.erase(first, last);
+    return result;
+  }
+
+  /**
+   * @brief Activity variables `a = OR(inputs)` of the first `count` S-boxes
+   * in round order whose inputs are not all input bits of the cipher, which
+   * a fixed input would decide.
+   */
+  std::vector<bonc::sat_modeller::Variable> addSBoxActivities(
+      std::size_t count) {
+    std::vector<bonc::sat_modeller::Variable> activities;
+    for (auto& [iteration, sboxes] : iteration_sbox_inputs) {
+      for (auto& inputs : sboxes) {
+        if (activities.size() == count) {
+          return activities;
+        }
+        if (std::ranges::all_of(inputs, [&](auto var) {
+              return var == FALSE || hasKind(var, Input);
+            })) {
+          continue;
+        }
+        auto activity = model.createVariable("active");
+        model.addOrClause(inputs, activity);
+        activities.push_back(activity);
+      }
+    }
+    return activities;
+  }
+
+  /**
+   * @brief Approximate bytes taken by the memo tables and variable sets.
+   */
+  std::size_t memoryUsage() const {
+    using bonc::sat_modeller::Variable;
+    // a hash node holds the key, value and next pointer, plus its bucket
+    auto block_node = sizeof(std::pair<bonc::SBoxInputBlock, std::size_t>)
+                    + 2 * sizeof(void*);
+    auto usage = expr_vars.capacity() * sizeof(std::uint32_t)
+               + modelled_nodes.capacity() * sizeof(const bonc::BitExpr*)
+               + variable_kinds.capacity()
+               + (weight_vars.capacity() + input_vars.capacity()
+                  + sbox_outputs.capacity())
+                     * sizeof(Variable)
+               + modelled_sbox_inputs.size() * block_node;
+    for (auto& [block, offset] : modelled_sbox_inputs) {
+      usage += block.inputs.capacity() * sizeof(bonc::Ref<bonc::BitExpr>);
+    }
+    return usage;
+  }
+
+  void setCardinalityEncoding(
+      bonc::sat_modeller::CardinalityEncoding encoding) {
+    cardinality_encoding = encoding;
+  }
+  /**
+   * @brief The encoded weight bound, available after `complete`.
+   */
+  const std::optional<bonc::sat_modeller::CardinalityBound>& getWeightBound()
+      const {
+    return weight_bound;
+  }
+  /**
+   * @brief Assumptions tightening the weight bound to `k`.
+   */
+  std::vector<bonc::sat_modeller::Literal> assumeWeightAtMost(std::size_t k) {
+    assert(weight_bound);
+    return weight_bound->assumeAtMost(model, k);
+  }
+
+  /**
+   * @brief What espresso minimises into the template of `lookup`, built from
+   * the nonzero entries of its table.
+   */
+  bonc::sat_modeller::EspressoCover tableTemplateCover(
+      const bonc::LookupTable* lookup) const {
+    auto input_width = lookup->getInputWidth();
+    auto& entries =
+        differential() ? lookup->getSparseDDT() : lookup->getSparseLAT();
+    return bonc::sat_modeller::SATModel::tableTemplateCover(
+        input_width, lookup->getOutputWidth(), entries,
+        [this, input_width](int x) -> std::size_t {
+          return entryWeight(input_width, x);
+        });
+  }
 
 private:
+  const bonc::LookupTable::DistributionTable& distributionTable(
+      const bonc::LookupTable* lookup) const {
+    return differential() ? lookup->getDDT() : lookup->getLAT();
+  }
+
+  /**
+   * @brief Weight of a nonzero DDT or LAT entry `x`.
+   */
+  std::size_t entryWeight(std::size_t input_width, int x) const {
+    if (differential()) {
+      return input_width - int(std::log2(x));
+    }
+    return input_width - int(std::log2(std::abs(x))) - 1;
+  }
+
   const bonc::sat_modeller::TableTemplate* buildTableTemplate(
       const bonc::LookupTable* lookup) {
     using namespace bonc::sat_modeller;
     assert(lookup);
+    if (shards) {
+      return shards->templates.at(lookup);
+    }
     if (auto it = known_templates.find(lookup); it != known_templates.end()) {
       return it->second.get();
     }
-    auto& table =
-        type == ModellingType::DDT ? lookup->getDDT() : lookup->getLAT();
-    auto input_width = lookup->getInputWidth();
-    SATModel::GetWeightFunction ddt_weight_fn =
-        [input_width](int x) -> std::size_t {
-      return input_width - int(std::log2(x));
-    };
-    SATModel::GetWeightFunction lat_weight_fn =
-        [input_width](int x) -> std::size_t {
-      return input_width - int(std::log2(std::abs(x))) - 1;
-    };
-    auto& weight_fn =
-        type == ModellingType::DDT ? ddt_weight_fn : lat_weight_fn;
-    auto template_ = model.buildTableTemplate(table, std::move(weight_fn));
+    auto template_ = model.buildTableTemplate(tableTemplateCover(lookup));
     auto template_ptr = std::make_unique<TableTemplate>(std::move(template_));
     auto raw_ptr = template_ptr.get();
     known_templates.emplace(lookup, std::move(template_ptr));
@@ -97,7 +412,17 @@ private:
     std::vector<bonc::sat_modeller::Variable> output_vars;
     if (auto modelled_it = modelled_sbox_inputs.find(block);
         modelled_it != modelled_sbox_inputs.end()) {
-      output_vars = modelled_it->second;
+      auto output_width = block.table->getOutputWidth();
+      if (output_offset >= int(output_width)) {
+        return FALSE;
+      }
+      return sbox_outputs.at(modelled_it->second + output_offset);
+    } else if (auto owner = ownerOf(block); owner.shard != shard_index) {
+      auto foreign = shards->blocks.wait(block);
+      for (auto var : foreign.outputs) {
+        output_vars.push_back(importVariable(foreign.shard, var));
+      }
+      setModelled(block, output_vars);
     } else {
       auto [inputs, table] = block;
       std::vector<bonc::sat_modeller::Variable> input_vars;
@@ -106,13 +431,23 @@ private:
                              std::bind_front(&Modeller::traverse, this));
       output_vars = model.createVariables(
           table->getOutputWidth(), std::format("{}_o", table->getName()));
+      if (truncated()) {
+        addSBoxActivity(table.get(), input_vars, output_vars);
+      } else {
+        auto template_ = buildTableTemplate(table.get());
 
-      auto template_ = buildTableTemplate(table.get());
-
-      auto weight_vars =
-          model.addWeightTableClauses(*template_, input_vars, output_vars);
-      this->weight_vars.insert_range(weight_vars);
-      modelled_sbox_inputs.emplace(block, output_vars);
+        auto weight_vars =
+            model.addWeightTableClauses(*template_, input_vars, output_vars);
+        for (auto var : weight_vars) {
+          addVariable(var, Weight);
+        }
+        iteration_weight_vars[current_iteration].append_range(weight_vars);
+        iteration_sbox_inputs[current_iteration].push_back(input_vars);
+      }
+      setModelled(block, output_vars);
+      if (owner.shared) {
+        shards->blocks.publish(block, {shard_index, output_vars});
+      }
     }
     if (output_offset >= int(output_vars.size())) {
       // Preprocess always runs on 8-bits unit, but s-box can be smaller width
@@ -121,16 +456,334 @@ private:
     return output_vars.at(output_offset);
   }
 
+  /**
+   * @brief Truncated S-box: it is active iff any input or output bit is, and
+   * a zero input or output is kept for the other side if no transition of
+   * the table leaves it.
+   */
+  void addSBoxActivity(
+      const bonc::LookupTable* table,
+      const std::vector<bonc::sat_modeller::Variable>& input_vars,
+      const std::vector<bonc::sat_modeller::Variable>& output_vars) {
+    auto& distribution = distributionTable(table);
+    auto max_entry = 0;
+    bool zero_in_zero_out = true, zero_out_zero_in = true;
+    for (auto a = 0uz; a < distribution.size(); a++) {
+      for (auto b = 0uz; b < distribution[a].size(); b++) {
+        auto entry = distribution[a][b];
+        if (entry == 0 || (a == 0 && b == 0)) {
+          continue;
+        }
+        max_entry = std::max(max_entry, std::abs(entry));
+        zero_in_zero_out = zero_in_zero_out && a != 0;
+        zero_out_zero_in = zero_out_zero_in && b != 0;
+      }
+    }
+    auto bits = input_vars;
+    bits.append_range(output_vars);
+    auto activity =
+        model.createVariable(std::format("{}_active", table->getName()));
+    model.addOrClause(bits, activity);
+    std::vector<bonc::sat_modeller::Literal> clause;
+    auto imply = [&](bonc::sat_modeller::Variable bit, auto& others) {
+      clause.assign_range(others);
+      clause.push_back(-bit);
+      model.addClause(clause);
+    };
+    if (zero_in_zero_out) {
+      for (auto output : output_vars) {
+        imply(output, input_vars);
+      }
+    }
+    if (zero_out_zero_in) {
+      for (auto input : input_vars) {
+        imply(input, output_vars);
+      }
+    }
+    if (max_entry != 0) {
+      if (auto weight = entryWeight(table->getInputWidth(), max_entry)) {
+        sbox_activities.push_back({activity, weight});
+      }
+    }
+  }
+
+  std::optional<bonc::sat_modeller::Variable> modelledVariable(
+      const bonc::BitExpr* expr) const {
+    auto id = expr->getId();
+    if (id < expr_vars.size() && expr_vars[id] != 0) {
+      return bonc::sat_modeller::Variable(expr_vars[id]);
+    }
+    return std::nullopt;
+  }
+  void setModelled(const bonc::BitExpr* expr,
+                   bonc::sat_modeller::Variable var) {
+    auto id = expr->getId();
+    if (id >= expr_vars.size()) {
+      expr_vars.resize(id + 1, 0);
+    }
+    expr_vars[id] = static_cast<std::uint32_t>(var.getIndex());
+    modelled_nodes.push_back(expr);
+  }
+  void setModelled(const bonc::SBoxInputBlock& block,
+                   std::span<const bonc::sat_modeller::Variable> outputs) {
+    modelled_sbox_inputs.emplace(block, sbox_outputs.size());
+    sbox_outputs.append_range(outputs);
+  }
+
+  bool hasKind(bonc::sat_modeller::Variable var, VariableKind kind) const {
+    return var.getIndex() < variable_kinds.size()
+        && (variable_kinds[var.getIndex()] & kind);
+  }
+  void addVariable(bonc::sat_modeller::Variable var, VariableKind kind) {
+    if (var.getIndex() >= variable_kinds.size()) {
+      variable_kinds.resize(var.getIndex() + 1, 0);
+    }
+    variable_kinds[var.getIndex()] |= kind;
+    if (kind == Weight) {
+      weight_vars.push_back(var);
+    } else if (kind == Input) {
+      input_vars.push_back(var);
+    }
+  }
+
+  ModelShards::Owner ownerOf(const bonc::BitExpr* expr) const {
+    return shards ? shards->expr_owners.at(expr->getId())
+                  : ModelShards::Owner{shard_index, false};
+  }
+  ModelShards::Owner ownerOf(const bonc::SBoxInputBlock& block) const {
+    return shards ? shards->block_owners.at(block)
+                  : ModelShards::Owner{shard_index, false};
+  }
+
+  /**
+   * @brief Find the lowest shard reaching each node, the way `traverse`
+   * walks the DAG. A node first reached by a lower shard is not walked
+   * again, as the shard reaching it later only waits for its variable.
+   */
+  void planExpr(const bonc::Ref<bonc::BitExpr>& expr, std::size_t shard,
+                ModelShards& plan) {
+    auto id = expr->getId();
+    if (id >= plan.expr_owners.size()) {
+      plan.expr_owners.resize(id + 1);
+    }
+    if (auto& owner = plan.expr_owners[id];
+        owner.shard != ModelShards::UNPLANNED) {
+      owner.shared = owner.shared || owner.shard != shard;
+      return;
+    } else {
+      owner = {shard, false};
+    }
+    switch (expr->getKind()) {
+      case bonc::BitExpr::Read: {
+        auto read_expr = boost::static_pointer_cast<bonc::ReadBitExpr>(expr);
+        auto target = read_expr->getTarget();
+        if (target->getKind() != bonc::ReadTarget::Input) {
+          planExpr(target->update_expressions.at(read_expr->getOffset()),
+                   shard, plan);
+        }
+        break;
+      }
+      case bonc::BitExpr::Lookup: {
+        auto lookup_expr =
+            boost::static_pointer_cast<bonc::LookupBitExpr>(expr);
+        planBlock({lookup_expr->getInputs(), lookup_expr->getTable()}, shard,
+                  plan);
+        break;
+      }
+      case bonc::BitExpr::Not:
+        planExpr(boost::static_pointer_cast<bonc::NotBitExpr>(expr)->getExpr(),
+                 shard, plan);
+        break;
+      case bonc::BitExpr::And:
+      case bonc::BitExpr::Or: {
+        auto binary_expr =
+            boost::static_pointer_cast<bonc::BinaryBitExpr>(expr);
+        planBlock({{binary_expr->getLeft(), binary_expr->getRight()},
+                   expr->getKind() == bonc::BitExpr::And ? AND_TABLE
+                                                         : OR_TABLE},
+                  shard, plan);
+        break;
+      }
+      case bonc::BitExpr::Xor: {
+        auto xor_expr = boost::static_pointer_cast<bonc::BinaryBitExpr>(expr);
+        planExpr(xor_expr->getLeft(), shard, plan);
+        planExpr(xor_expr->getRight(), shard, plan);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  void planBlock(const bonc::SBoxInputBlock& block, std::size_t shard,
+                 ModelShards& plan) {
+    auto [it, inserted] =
+        plan.block_owners.try_emplace(block, ModelShards::Owner{shard, false});
+    if (!inserted) {
+      it->second.shared = it->second.shared || it->second.shard != shard;
+      return;
+    }
+    // tables are generated lazily, so do it before the threads start
+    distributionTable(block.table.get());
+    if (!truncated()) {
+      buildTableTemplate(block.table.get());
+    }
+    for (auto& input : block.inputs) {
+      planExpr(input, shard, plan);
+    }
+  }
+
+  /**
+   * @brief Local proxy of variable `var` of another shard.
+   */
+  bonc::sat_modeller::Variable importVariable(
+      std::size_t shard, bonc::sat_modeller::Variable var) {
+    auto key = std::pair{shard, var.getIndex()};
+    if (auto it = import_proxies.find(key); it != import_proxies.end()) {
+      return it->second;
+    }
+    auto proxy = model.createVariable("import");
+    import_proxies.emplace(key, proxy);
+    imports.emplace_back(proxy,
+                         ModelShards::ForeignVariable{shard, var, false});
+    return proxy;
+  }
+
+  /**
+   * @brief Append the clauses and bookkeeping of `shard`, giving its own
+   * variables fresh indices here and its proxies the variables they stand
+   * for.
+   *
+   * @param mappings Variables of lower shards in this model, by shard;
+   * shard 0 is this modeller itself.
+   * @return Variables of `shard` in this model, by index.
+   */
+  std::vector<bonc::sat_modeller::Variable> mergeShard(
+      const Modeller& shard,
+      std::span<const std::vector<bonc::sat_modeller::Variable>> mappings) {
+    using bonc::sat_modeller::Variable;
+    auto& shard_model = shard.model;
+    std::vector<Variable> mapping(shard_model.variableSize(), FALSE);
+    std::vector<bool> mapped(shard_model.variableSize(), false);
+    mapped[shard.FALSE.getIndex()] = true;
+    for (auto& [proxy, foreign] : shard.imports) {
+      mapping[proxy.getIndex()] =
+          foreign.shard == 0
+              ? foreign.var
+              : mappings[foreign.shard][foreign.var.getIndex()];
+      mapped[proxy.getIndex()] = true;
+    }
+    for (auto i = 1uz; i < shard_model.variableSize(); i++) {
+      if (!mapped[i]) {
+        mapping[i] = model.copyVariable(shard_model, i);
+      }
+    }
+    auto map = [&](Variable var) { return mapping[var.getIndex()]; };
+
+    std::vector<bonc::sat_modeller::Literal> clause;
+    for (auto stored : shard_model.getClauses()) {
+      // the shard's own `-FALSE` is already here
+      if (stored.size() == 1
+          && stored[0] == -bonc::sat_modeller::Literal::ValueT(shard.FALSE.getIndex())) {
+        continue;
+      }
+      clause.clear();
+      for (auto lit : stored) {
+        auto var = mapping[std::abs(lit)];
+        clause.push_back(lit < 0 ? -var : bonc::sat_modeller::Literal(var));
+      }
+      model.addClause(clause);
+    }
+    std::vector<Variable> xor_vars;
+    for (auto i = 0uz; i < shard_model.getXors().size(); i++) {
+      auto [variables, rhs] = shard_model.getXors()[i];
+      xor_vars.clear();
+      for (auto var : variables) {
+        xor_vars.push_back(mapping[var]);
+      }
+      model.addXorConstraint(xor_vars, rhs);
+    }
+
+    for (auto var : shard.weight_vars) {
+      addVariable(map(var), Weight);
+    }
+    for (auto var : shard.input_vars) {
+      addVariable(map(var), Input);
+    }
+    for (auto i = 1uz; i < shard.variable_kinds.size(); i++) {
+      if (shard.variable_kinds[i] & Free) {
+        addVariable(mapping[i], Free);
+      }
+    }
+    for (auto& [iteration, vars] : shard.iteration_weight_vars) {
+      iteration_weight_vars[iteration].append_range(
+          vars | std::views::transform(map));
+    }
+    for (auto& [iteration, sboxes] : shard.iteration_sbox_inputs) {
+      for (auto& inputs : sboxes) {
+        iteration_sbox_inputs[iteration].push_back(
+            inputs | std::views::transform(map)
+            | std::ranges::to<std::vector>());
+      }
+    }
+    for (auto [var, weight] : shard.sbox_activities) {
+      sbox_activities.push_back({map(var), weight});
+    }
+    for (auto expr : shard.modelled_nodes) {
+      if (!modelledVariable(expr)) {
+        setModelled(expr, map(*shard.modelledVariable(expr)));
+      }
+    }
+    for (auto& [block, offset] : shard.modelled_sbox_inputs) {
+      if (!modelled_sbox_inputs.contains(block)) {
+        auto outputs = std::span(shard.sbox_outputs)
+                           .subspan(offset, block.table->getOutputWidth());
+        setModelled(block, outputs | std::views::transform(map)
+                               | std::ranges::to<std::vector>());
+      }
+    }
+    return mapping;
+  }
+
   bonc::sat_modeller::Variable createFreeVariable() {
     auto variable = this->model.createVariable("FREE");
-    this->free_vars.insert(variable);
+    addVariable(variable, Free);
     return variable;
   }
 
+  // Max operands gathered into one merged XOR constraint
+  static constexpr std::size_t MAX_XOR_WIDTH = 32;
+
+  /**
+   * Flatten a tree of XOR nodes, looking through NOT which keeps differences,
+   * into the variables of its operands. Subtrees already modelled are used
+   * as-is, so shared nodes keep a single variable.
+   */
+  void collectXorOperands(bonc::Ref<bonc::BitExpr> expr,
+                          std::vector<bonc::sat_modeller::Variable>& operands) {
+    auto xor_expr = boost::static_pointer_cast<bonc::BinaryBitExpr>(expr);
+    for (auto operand : {xor_expr->getLeft(), xor_expr->getRight()}) {
+      auto node = operand;
+      while (node->getKind() == bonc::BitExpr::Not) {
+        node = boost::static_pointer_cast<bonc::NotBitExpr>(node)->getExpr();
+      }
+      // nodes other shards see need a variable of their own
+      auto owner = ownerOf(node.get());
+      if (node->getKind() == bonc::BitExpr::Xor
+          && !modelledVariable(node.get())
+          && owner.shard == shard_index && !owner.shared
+          && operands.size() + 2 < MAX_XOR_WIDTH) {
+        collectXorOperands(node, operands);
+      } else {
+        operands.push_back(traverse(operand));
+      }
+    }
+  }
+
   bonc::sat_modeller::Variable traverse_impl(bonc::Ref<bonc::BitExpr> expr) {
     switch (expr->getKind()) {
       case bonc::BitExpr::Constant: {
-        if (this->type == ModellingType::DDT) {
+        if (differential()) {
           return FALSE;
         } else {
           return createFreeVariable();
@@ -146,16 +799,23 @@ private:
           if (is_input_bit) {
             auto input =
                 model.createVariable(std::format("input_{}_{}", name, offset));
-            this->input_vars.insert(input);
+            addVariable(input, Input);
             return input;
-          } else if (this->type == ModellingType::DDT) {
+          } else if (differential()) {
             return FALSE;
           } else {
             return this->createFreeVariable();
           }
         }
         auto expr = target->update_expressions.at(offset);
-        return traverse(expr);
+        auto iteration = current_iteration;
+        if (auto it = iteration_indices.find(target.get());
+            it != iteration_indices.end()) {
+          current_iteration = it->second;
+        }
+        auto variable = traverse(expr);
+        current_iteration = iteration;
+        return variable;
       }
       case bonc::BitExpr::Lookup: {
         auto lookup_expr =
@@ -185,20 +845,49 @@ private:
             0);
       }
       case bonc::BitExpr::Xor: {
-        auto xor_expr = boost::static_pointer_cast<bonc::BinaryBitExpr>(expr);
-        auto left = traverse(xor_expr->getLeft());
-        auto right = traverse(xor_expr->getRight());
-        if (this->type == ModellingType::DDT) {
-          if (left == FALSE) {
-            return right;
+        if (differential()) {
+          std::vector<bonc::sat_modeller::Variable> operands;
+          collectXorOperands(expr, operands);
+          // equal differences cancel out, FALSE has no effect
+          std::ranges::sort(operands, {}, &bonc::sat_modeller::Variable::getIndex);
+          std::vector<bonc::sat_modeller::Variable> reduced;
+          for (auto i = 0uz; i < operands.size(); i++) {
+            if (i + 1 < operands.size() && operands[i] == operands[i + 1]) {
+              i++;
+            } else if (operands[i] != FALSE) {
+              reduced.push_back(operands[i]);
+            }
+          }
+          if (reduced.empty()) {
+            return FALSE;
+          }
+          if (reduced.size() == 1) {
+            return reduced.front();
           }
-          if (right == FALSE) {
-            return left;
+          if (truncated()) {
+            // one active branch alone cannot cancel out
+            auto result = model.createVariable("xor");
+            reduced.push_back(result);
+            std::vector<bonc::sat_modeller::Literal> clause;
+            for (auto i = 0uz; i < reduced.size(); i++) {
+              clause.clear();
+              clause.push_back(-reduced[i]);
+              for (auto j = 0uz; j < reduced.size(); j++) {
+                if (j != i) {
+                  clause.push_back(reduced[j]);
+                }
+              }
+              model.addClause(clause);
+            }
+            return result;
           }
           auto result = model.createVariable("xor");
-          model.addXorClause({left, right}, result);
+          model.addXorClause(reduced, result);
           return result;
         } else {
+          auto xor_expr = boost::static_pointer_cast<bonc::BinaryBitExpr>(expr);
+          auto left = traverse(xor_expr->getLeft());
+          auto right = traverse(xor_expr->getRight());
           // 线性传播过 XOR 要求两侧掩码相同
           model.addEquivalentClause({left, right});
           return left;
@@ -213,34 +902,227 @@ private:
 public:
   bonc::sat_modeller::Variable traverse(bonc::Ref<bonc::BitExpr> expr) {
     auto expr_raw = expr.get();
-    if (auto it = modelled_exprs.find(expr_raw); it != modelled_exprs.end()) {
-      return it->second;
+    if (auto var = modelledVariable(expr_raw)) {
+      return *var;
+    }
+    auto owner = ownerOf(expr_raw);
+    if (owner.shard != shard_index) {
+      auto foreign = shards->exprs.wait(expr_raw);
+      if (foreign.free) {
+        return createFreeVariable();
+      }
+      auto variable = importVariable(foreign.shard, foreign.var);
+      setModelled(expr_raw, variable);
+      return variable;
     }
     auto variable = traverse_impl(std::move(expr));
     // always use unique variable if it is 'free'
-    if (free_vars.contains(variable)) {
+    if (hasKind(variable, Free)) {
+      if (owner.shared) {
+        shards->exprs.publish(expr_raw, {shard_index, variable, true});
+      }
       return createFreeVariable();
     }
 
-    modelled_exprs.emplace(expr_raw, variable);
+    setModelled(expr_raw, variable);
+    if (owner.shared) {
+      shards->exprs.publish(expr_raw, {shard_index, variable, false});
+    }
     return variable;
   }
 
+  /**
+   * @brief Build the templates of all tables reached from `exprs` together in
+   * `pool`, instead of one at a time as `traverse` first meets them.
+   */
+  void buildTableTemplates(std::span<const bonc::Ref<bonc::BitExpr>> exprs,
+                           bonc::sat_modeller::EspressoPool& pool) {
+    if (truncated()) {
+      return;
+    }
+    std::vector<const bonc::LookupTable*> tables;
+    auto addTable = [&](const bonc::LookupTable* table) {
+      if (!known_templates.contains(table)
+          && !std::ranges::contains(tables, table)) {
+        tables.push_back(table);
+      }
+    };
+    std::vector<bool> visited;
+    std::vector<const bonc::BitExpr*> stack;
+    for (auto& expr : exprs) {
+      stack.push_back(expr.get());
+    }
+    while (!stack.empty()) {
+      auto expr = stack.back();
+      stack.pop_back();
+      if (expr->getId() >= visited.size()) {
+        visited.resize(expr->getId() + 1);
+      }
+      if (visited[expr->getId()]) {
+        continue;
+      }
+      visited[expr->getId()] = true;
+      switch (expr->getKind()) {
+        case bonc::BitExpr::Read: {
+          auto read_expr = static_cast<const bonc::ReadBitExpr*>(expr);
+          auto target = read_expr->getTarget();
+          if (target->getKind() != bonc::ReadTarget::Input) {
+            stack.push_back(
+                target->update_expressions.at(read_expr->getOffset()).get());
+          }
+          break;
+        }
+        case bonc::BitExpr::Lookup: {
+          auto lookup_expr = static_cast<const bonc::LookupBitExpr*>(expr);
+          addTable(lookup_expr->getTable().get());
+          for (auto& input : lookup_expr->getInputs()) {
+            stack.push_back(input.get());
+          }
+          break;
+        }
+        case bonc::BitExpr::Not:
+          stack.push_back(
+              static_cast<const bonc::NotBitExpr*>(expr)->getExpr().get());
+          break;
+        case bonc::BitExpr::And:
+        case bonc::BitExpr::Or:
+        case bonc::BitExpr::Xor: {
+          auto binary_expr = static_cast<const bonc::BinaryBitExpr*>(expr);
+          if (expr->getKind() == bonc::BitExpr::And) {
+            addTable(AND_TABLE.get());
+          } else if (expr->getKind() == bonc::BitExpr::Or) {
+            addTable(OR_TABLE.get());
+          }
+          stack.push_back(binary_expr->getLeft().get());
+          stack.push_back(binary_expr->getRight().get());
+          break;
+        }
+        default:
+          break;
+      }
+    }
+
+    std::vector<std::future<bonc::sat_modeller::TableTemplate>> jobs;
+    for (auto table : tables) {
+      jobs.push_back(pool.submit(tableTemplateCover(table)));
+    }
+    for (auto i = 0uz; i < tables.size(); i++) {
+      known_templates.emplace(
+          tables[i],
+          std::make_unique<bonc::sat_modeller::TableTemplate>(jobs[i].get()));
+    }
+  }
+
+  /**
+   * @brief `traverse` all `exprs` in `threads` shards, each one a contiguous
+   * slice of `exprs`, then merge the shards into this model in order; see
+   * `ModelShards`.
+   *
+   * @return The variable of each expression.
+   */
+  std::vector<bonc::sat_modeller::Variable> traverseParallel(
+      std::span<const bonc::Ref<bonc::BitExpr>> exprs, std::size_t threads) {
+    auto slice = [&](std::size_t shard) {
+      auto first = exprs.size() * shard / threads;
+      auto last = exprs.size() * (shard + 1) / threads;
+      return exprs.subspan(first, last - first);
+    };
+    ModelShards plan;
+    for (auto shard = 0uz; shard < threads; shard++) {
+      for (auto& expr : slice(shard)) {
+        planExpr(expr, shard, plan);
+      }
+    }
+    for (auto& [lookup, template_] : known_templates) {
+      plan.templates.emplace(lookup, template_.get());
+    }
+
+    // shard 0 is this modeller, the others model into memory
+    std::vector<std::unique_ptr<Modeller>> modellers;
+    for (auto shard = 1uz; shard < threads; shard++) {
+      auto modeller = std::make_unique<Modeller>(type);
+      modeller->model.setXorEncoding(model.getXorEncoding(),
+                                     model.getXorCutWidth());
+      modeller->input_names = input_names;
+      modeller->iteration_indices = iteration_indices;
+      modeller->current_iteration = current_iteration;
+      modellers.push_back(std::move(modeller));
+    }
+    auto modellerOf = [&](std::size_t shard) -> Modeller& {
+      return shard == 0 ? *this : *modellers[shard - 1];
+    };
+    std::vector<std::vector<bonc::sat_modeller::Variable>> outputs(threads);
+    std::vector<std::exception_ptr> errors(threads);
+    {
+      std::vector<std::jthread> workers;
+      for (auto shard = 0uz; shard < threads; shard++) {
+        auto& modeller = modellerOf(shard);
+        modeller.shards = &plan;
+        modeller.shard_index = shard;
+        workers.emplace_back([&, shard] {
+          try {
+            for (auto& expr : slice(shard)) {
+              outputs[shard].push_back(modellerOf(shard).traverse(expr));
+            }
+          } catch (...) {
+            errors[shard] = std::current_exception();
+            plan.exprs.cancel();
+            plan.blocks.cancel();
+          }
+        });
+      }
+    }
+    shards = nullptr;
+    for (auto& error : errors) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+
+    std::vector<std::vector<bonc::sat_modeller::Variable>> mappings(1);
+    auto result = std::move(outputs[0]);
+    for (auto shard = 1uz; shard < threads; shard++) {
+      mappings.push_back(mergeShard(*modellers[shard - 1], mappings));
+      for (auto var : outputs[shard]) {
+        result.push_back(mappings.back()[var.getIndex()]);
+      }
+    }
+    return result;
+  }
+
   void complete(std::optional<std::size_t> max_weight = std::nullopt) {
     this->setWeightLessThen(max_weight
                                 ? *max_weight
-                                : (this->type == ModellingType::DDT
+                                : (differential()
                                        ? this->input_vars.size() - 1
                                        : (this->input_vars.size() - 1) / 2));
     this->assureInputNotEmpty();
+    model.finish();
   }
 
 #ifdef USE_CRYPTOMINISAT5
+  std::size_t getWeight(
+      const std::vector<bonc::SolvedModelValue>& values) const {
+    if (truncated()) {
+      auto weight = 0uz;
+      for (auto [var, var_weight] : sbox_activities) {
+        if (values.at(var.getIndex()) == bonc::SolvedModelValue::True) {
+          weight += var_weight;
+        }
+      }
+      return weight;
+    }
+    return std::ranges::count_if(weight_vars, [&](auto var) {
+      return values.at(var.getIndex()) == bonc::SolvedModelValue::True;
+    });
+  }
+
   void debugSolution(const std::vector<bonc::SolvedModelValue>& values) const {
     std::unordered_map<bonc::SBoxInputBlock,
                        std::vector<const bonc::LookupBitExpr*>>
         visited;
-    for (auto& [expr, var] : modelled_exprs) {
+    for (auto expr : modelled_nodes) {
+      auto var = *modelledVariable(expr);
       if (expr->getKind() == bonc::BitExpr::Lookup) {
         auto lookup_expr = static_cast<const bonc::LookupBitExpr*>(expr);
         bonc::SBoxInputBlock block{lookup_expr->getInputs(),
@@ -252,7 +1134,7 @@ public:
         visited.at(block).at(lookup_expr->getOutputOffset()) = lookup_expr;
       }
       std::cout << values.at(var.getIndex()) << " | ";
-      std::cout << std::setw(20) << model.getVariableDetail(var.getIndex()).name
+      std::cout << std::setw(20) << model.getVariableName(var.getIndex())
                 << " | ";
       expr->print(std::cout);
       if (expr->getKind() == bonc::BitExpr::Read) {
@@ -272,8 +1154,24 @@ public:
 private:
   void setWeightLessThen(int k) {
     assert(k > 0);
-    model.addSequentialCounterLessEqualClause(
-        std::vector(std::from_range, weight_vars), k);
+    weight_limit = k;
+    if (truncated()) {
+      weight_bound = model.addWeightedLessEqual(sbox_activities, std::size_t(k));
+      return;
+    }
+    if (round_bounds) {
+      std::vector<bonc::sat_modeller::Variable> x;
+      for (auto& [iteration, vars] : iteration_weight_vars) {
+        x.append_range(vars);
+        round_ends.push_back(x.size() - 1);
+      }
+      if (!x.empty()) {
+        round_counter = model.addSequentialCounter(x, std::size_t(k));
+      }
+      return;
+    }
+    weight_bound = model.addCardinalityLessEqual(weight_vars, std::size_t(k),
+                                                 cardinality_encoding);
   }
   void assureInputNotEmpty() {
     if (input_vars.empty()) {
@@ -311,6 +1209,347 @@ void printStateValue(std::vector<bonc::SolvedModelValue> values) {
   std::println("");
 }
 
+template <std::ranges::input_range Targets>
+void printTrail(const bonc::FrontendResultParser& parser, Targets&& targets,
+                const Modeller& modeller,
+                const std::vector<bonc::SolvedModelValue>& values,
+                const boost::regex& state_name_regex) {
+  std::println("### print-state begin");
+  for (const bonc::Ref<bonc::ReadTarget>& target : targets) {
+    auto& name = target->getName();
+    if (!boost::regex_match(name, state_name_regex)) {
+      continue;
+    }
+    std::println("# State {}: ", name);
+    std::vector<bonc::SolvedModelValue> state_values;
+    for (auto index : std::views::iota(0uz, target->getSize() * CHAR_BIT)) {
+      auto expr = parser.createExpr<bonc::ReadBitExpr>(target, index);
+      auto var_index = modeller.getExprIndex(expr);
+      if (var_index <= 0) {
+        state_values.push_back(bonc::SolvedModelValue::Undefined);
+        continue;
+      }
+      state_values.push_back(values.at(var_index));
+    }
+    printStateValue(state_values);
+  }
+  std::println("### print-state end");
+}
+
+enum class OptimizeStrategy { Linear, Binary, Ascend };
+
+/**
+ * @brief Search the minimum weight within one solver, tightening the
+ * incremental weight bound by assumptions so learnt clauses carry over.
+ *
+ * Strategies:
+ * - Linear: SAT-UNSAT descent, each bound just below the last found weight;
+ * - Binary: bisect between the proven lower bound and the best weight;
+ * - Ascend: UNSAT-SAT ascent from 0, the first satisfiable bound is optimal.
+ *   With a single cardinality constraint this is what core-guided search
+ *   degenerates to.
+ *
+ * `report` is called on every improved trail.
+ *
+ * @param lower_bound Weight no trail is known to go below, e.g. from
+ * `activeSBoxBound`; a trail of this weight ends the search.
+ * @return The optimal weight, or nothing if no trail is within the initial
+ * bound.
+ */
+std::optional<std::size_t> optimizeWeight(
+    CMSat::SATSolver& solver, Modeller& modeller, OptimizeStrategy strategy,
+    std::function<void(const std::vector<bonc::SolvedModelValue>&)> report,
+    std::size_t lower_bound = 0) {
+  bonc::backend_common::Timer timer;
+  std::optional<std::size_t> best;
+  // bounds below `lower` are known to be unsatisfiable
+  auto lower = lower_bound;
+  auto upper = modeller.getWeightBound()->getBound();
+
+  auto attempt = [&](std::size_t k) {
+    auto assumptions = modeller.assumeWeightAtMost(k);
+    auto values = bonc::solve(solver, assumptions);
+    if (values) {
+      auto weight = modeller.getWeight(*values);
+      std::println("Bound {}: SAT, weight {}, time: {}", k, weight,
+                   timer.elapsed_as<std::chrono::milliseconds>());
+      best = weight;
+      upper = weight;
+      report(*values);
+    } else {
+      std::println("Bound {}: UNSAT, time: {}", k,
+                   timer.elapsed_as<std::chrono::milliseconds>());
+      lower = k + 1;
+    }
+    return values.has_value();
+  };
+
+  switch (strategy) {
+    case OptimizeStrategy::Linear: {
+      auto k = upper;
+      while (attempt(k) && upper > lower) {
+        k = upper - 1;
+      }
+      break;
+    }
+    case OptimizeStrategy::Binary:
+      if (attempt(upper)) {
+        while (lower < upper) {
+          attempt(lower + (upper - lower - 1) / 2);
+        }
+      }
+      break;
+    case OptimizeStrategy::Ascend:
+      while (lower <= upper && !attempt(lower)) {
+      }
+      break;
+  }
+  return best;
+}
+
+/**
+ * @brief Lower bound on the weight of any trail from the truncated model of
+ * `type`: the least weight of active S-boxes, found by raising the bound
+ * within one solver.
+ *
+ * @return Nothing if not even a truncated trail is within `max_weight`.
+ */
+std::optional<std::size_t> activeSBoxBound(
+    Modeller::ModellingType type, std::span<std::string> input_names,
+    std::span<const bonc::OutputInfo> outputs,
+    std::optional<std::size_t> max_weight) {
+  bonc::backend_common::Timer timer;
+  CMSat::SATSolver solver;
+  bonc::CMSatClauseSink sink{solver};
+  Modeller modeller(type, sink);
+  modeller.addInputNames(input_names);
+  for (auto& info : outputs) {
+    for (auto& expr : info.expressions) {
+      modeller.traverse(expr);
+    }
+  }
+  modeller.complete(max_weight);
+  std::println("Active S-box model variables: {}, clauses: {}",
+               modeller.model.variableSize(), modeller.model.clauseSize());
+  for (auto k = 0uz; k <= modeller.getWeightBound()->getBound(); k++) {
+    auto values = bonc::solve(solver, modeller.assumeWeightAtMost(k));
+    if (values) {
+      std::println("Active S-box bound: {}, time: {}", k,
+                   timer.elapsed_as<std::chrono::milliseconds>());
+      return k;
+    }
+  }
+  std::println("Active S-box bound: none within {}, time: {}",
+               modeller.getWeightBound()->getBound(),
+               timer.elapsed_as<std::chrono::milliseconds>());
+  return std::nullopt;
+}
+
+/**
+ * @brief Build the model once per cardinality encoding of the weight bound,
+ * each into a solver of its own, and report the size of the bound and the
+ * modelling time, and with `solve` the solving time, side by side.
+ */
+void compareCardinalityEncodings(
+    Modeller::ModellingType type, std::span<std::string> input_names,
+    std::span<const bonc::OutputInfo> outputs,
+    std::optional<std::size_t> max_weight,
+    bonc::sat_modeller::XorEncoding xor_encoding, std::size_t xor_cut_width,
+    bool solve) {
+  using bonc::sat_modeller::CardinalityEncoding;
+  for (auto encoding : {CardinalityEncoding::SequentialCounter,
+                        CardinalityEncoding::Totalizer,
+                        CardinalityEncoding::ModuloTotalizer,
+                        CardinalityEncoding::CardinalityNetwork}) {
+    bonc::backend_common::Timer timer;
+    CMSat::SATSolver solver;
+    bonc::CMSatClauseSink sink{solver};
+    Modeller modeller(type, sink);
+    modeller.model.setXorEncoding(xor_encoding, xor_cut_width);
+    modeller.setCardinalityEncoding(encoding);
+    modeller.addInputNames(input_names);
+    for (auto& info : outputs) {
+      for (auto& expr : info.expressions) {
+        modeller.traverse(expr);
+      }
+    }
+    modeller.complete(max_weight);
+    std::print("{}: variables: {}, clauses: {}",
+               bonc::sat_modeller::cardinalityEncodingName(encoding),
+               modeller.model.variableSize(), modeller.model.clauseSize());
+    if (auto& bound = modeller.getWeightBound()) {
+      std::print(", bound variables: {}, bound clauses: {}",
+                 bound->auxVariables(), bound->auxClauses());
+    }
+    std::print(", modelling time: {}",
+               timer.elapsed_as<std::chrono::milliseconds>());
+    if (solve) {
+      timer.reset();
+      auto values = bonc::solve(solver);
+      std::print(", {}, solving time: {}",
+                 values ? "SATISFIABLE" : "UNSATISFIABLE",
+                 timer.elapsed_as<std::chrono::milliseconds>());
+    }
+    std::println("");
+  }
+}
+
+/**
+ * @brief Known optimal weights `best[i]` of `i` rounds, `best[0] = 0`, one
+ * "rounds weight" line per entry.
+ */
+std::vector<std::size_t> readRoundWeights(const std::string& path) {
+  std::vector<std::size_t> best{0};
+  std::ifstream ifs(path);
+  std::size_t rounds, weight;
+  while (ifs >> rounds >> weight) {
+    if (rounds != best.size()) {
+      break;
+    }
+    best.push_back(weight);
+  }
+  return best;
+}
+
+void writeRoundWeights(const std::string& path,
+                       std::span<const std::size_t> best) {
+  std::ofstream ofs(path);
+  for (auto i = 1uz; i < best.size(); i++) {
+    std::println(ofs, "{} {}", i, best[i]);
+  }
+  if (!ofs) {
+    throw std::runtime_error(std::format("Failed to write {}", path));
+  }
+}
+
+/**
+ * @brief Matsui's round-increasing search within one solver.
+ *
+ * For `i = 1, 2, ...` rounds the weight of the first `i` rounds is bounded by
+ * `k` ascending from `max(best[a] + best[i-a])`, under Matsui's bounding
+ * conditions derived from the `best` weights of fewer rounds; the first
+ * satisfiable `k` is optimal. Later rounds only extend a trail, so the prefix
+ * of the full model stands for the `i`-round cipher, and every optimal weight
+ * is assumed to hold for any run of `i` rounds, as for iterated ciphers.
+ *
+ * @param best Known optimal weights, `best[0] = 0`; extended in place, and
+ * written to `cache_path` after every round if that is not empty.
+ * @return The optimal weight of all rounds, whose trail goes to `report`.
+ */
+std::optional<std::size_t> searchRoundByRound(
+    CMSat::SATSolver& solver, Modeller& modeller,
+    std::vector<std::size_t>& best, const std::string& cache_path,
+    std::function<void(const std::vector<bonc::SolvedModelValue>&)> report) {
+  auto rounds = modeller.roundSize();
+  for (auto i = 1uz; i <= rounds; i++) {
+    if (i < best.size() && i < rounds) {
+      continue;
+    }
+    bonc::backend_common::Timer timer;
+    auto k = 0uz;
+    if (i < best.size()) {
+      k = best[i];
+    } else {
+      for (auto a = 1uz; a < i; a++) {
+        k = std::max(k, best[a] + best[i - a]);
+      }
+    }
+    std::optional<std::vector<bonc::SolvedModelValue>> values;
+    for (; k <= modeller.getWeightLimit(); k++) {
+      auto assumptions = modeller.assumeRoundsAtMost(i, k);
+      assumptions.append_range(modeller.assumeMatsuiBounds(i, k, best));
+      values = bonc::solve(solver, assumptions);
+      if (values) {
+        break;
+      }
+    }
+    if (!values) {
+      std::println("Rounds {}: no trail within weight {}, time: {}", i,
+                   modeller.getWeightLimit(),
+                   timer.elapsed_as<std::chrono::milliseconds>());
+      return std::nullopt;
+    }
+    std::println("Rounds {}: weight {}, time: {}", i, k,
+                 timer.elapsed_as<std::chrono::milliseconds>());
+    if (i == best.size()) {
+      best.push_back(k);
+      if (!cache_path.empty()) {
+        writeRoundWeights(cache_path, best);
+      }
+    }
+    if (i == rounds) {
+      report(*values);
+      return k;
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Enumerate the trails sharing the input and output values of `trail`
+ * whose weight is at most `weight + delta`, blocking each one on the
+ * modelled expressions and weight variables only.
+ *
+ * With more than one thread the search is split by the activity of the first
+ * S-boxes not decided by the fixed input, and each worker loads the model
+ * from `memory` into its own solver; otherwise the trails are blocked in
+ * `solver` itself.
+ *
+ * @param limit Stop after this many trails, 0 for no limit.
+ */
+bonc::TrailHull enumerateHull(
+    CMSat::SATSolver& solver, Modeller& modeller,
+    const bonc::sat_modeller::MemoryClauseSink* memory,
+    const std::vector<bonc::SolvedModelValue>& trail,
+    std::span<const bonc::sat_modeller::Variable> output_vars,
+    std::size_t delta, std::size_t threads, std::size_t limit) {
+  std::vector<bonc::sat_modeller::Literal> assumptions;
+  auto fix = [&](bonc::sat_modeller::Variable var) {
+    assumptions.push_back(trail.at(var.getIndex())
+                                  == bonc::SolvedModelValue::True
+                              ? bonc::sat_modeller::Literal(var)
+                              : -var);
+  };
+  std::ranges::for_each(modeller.getInputVars(), fix);
+  std::ranges::for_each(output_vars, fix);
+  auto max_weight = std::min(modeller.getWeight(trail) + delta,
+                             modeller.getWeightBound()->getBound());
+  assumptions.append_range(modeller.assumeWeightAtMost(max_weight));
+
+  auto trail_vars = modeller.getTrailVariables();
+  std::atomic<std::size_t> budget{
+      limit ? limit : std::numeric_limits<std::size_t>::max()};
+  bonc::TrailWeightFunction weight = [&](auto& values) {
+    return modeller.getWeight(values);
+  };
+  if (threads <= 1) {
+    return bonc::enumerateTrails(solver, assumptions, trail_vars, weight,
+                                 budget);
+  }
+  // about four cubes per thread
+  auto split_vars =
+      modeller.addSBoxActivities(std::bit_width(threads - 1) + 2);
+  return bonc::enumerateTrailsParallel(
+      memory->getClauses(), memory->getXors(),
+      modeller.model.variableSize() - 1, assumptions, trail_vars, split_vars,
+      threads, weight, budget);
+}
+
+void printTrailHull(const bonc::TrailHull& hull, bool is_differential) {
+  for (auto [weight, count] : hull.trails) {
+    std::println("Weight {}: {} trails", weight, count);
+  }
+  std::println("Trails: {}{}", hull.size(),
+               hull.complete ? "" : " (stopped at --enumerate-limit)");
+  if (is_differential) {
+    std::println("Differential probability: 2^{:.4f}",
+                 hull.log2Probability());
+  } else {
+    // expected linear potential, the sum of squared trail correlations
+    std::println("Linear hull potential: 2^{:.4f}", hull.log2Probability(2));
+  }
+}
+
 // int main() {
 //   bonc::sat_modeller::SATModel model;
 //   auto a = model.createVariable("a");
@@ -329,22 +1568,179 @@ void printStateValue(std::vector<bonc::SolvedModelValue> values) {
 
 namespace po = boost::program_options;
 
+void printPortfolioStats(const bonc::PortfolioResult& result) {
+  for (auto i = 0uz; i < result.stats.size(); i++) {
+    auto& stats = result.stats[i];
+    std::println("Solver {} ({}): {}, time: {}{}", i, stats.name,
+                 bonc::solveStatusName(stats.status), stats.time,
+                 result.winner == i ? " (winner)" : "");
+  }
+}
+
+/**
+ * @brief Solvers configured by --portfolio, --portfolio-external,
+ * --solver-threads and --time-limit, empty if a single in-process solver is
+ * enough.
+ */
+std::vector<bonc::PortfolioEntry> buildPortfolio(const po::variables_map& vm) {
+  std::vector<bonc::PortfolioEntry> externals;
+  if (vm.count("portfolio-external")) {
+    std::vector<std::string> names;
+    boost::split(names, vm["portfolio-external"].as<std::string>(),
+                 boost::is_any_of(","));
+    for (auto& name : names) {
+      if (auto entry = bonc::externalSolver(name)) {
+        externals.push_back(std::move(*entry));
+      } else {
+        std::println(stderr, "Solver {} is not found on PATH, skipped", name);
+      }
+    }
+  }
+  auto count = vm["portfolio"].as<std::size_t>();
+  if (count == 0 && externals.empty()) {
+    if (!vm.count("time-limit")) {
+      return {};
+    }
+    count = 1;
+  }
+  auto entries =
+      bonc::cmsatPortfolio(count, vm["solver-threads"].as<unsigned>());
+  entries.append_range(std::move(externals));
+  return entries;
+}
+
+std::optional<std::chrono::milliseconds> timeLimit(
+    const po::variables_map& vm) {
+  if (!vm.count("time-limit")) {
+    return std::nullopt;
+  }
+  return std::chrono::milliseconds(
+      std::int64_t(vm["time-limit"].as<double>() * 1000));
+}
+
+int solveDIMACS(const std::string& path, const po::variables_map& vm) {
+  bonc::backend_common::Timer timer;
+  auto cnf = bonc::sat_modeller::dimacs::read(path);
+  std::println("Loading time: {}, variables: {}, clauses: {}, xors: {}",
+               timer.elapsed_as<std::chrono::milliseconds>(),
+               cnf.variable_count, cnf.clauses.size(), cnf.xors.size());
+
+  timer.reset();
+  std::optional<std::vector<bonc::SolvedModelValue>> values;
+  if (auto portfolio = buildPortfolio(vm); !portfolio.empty()) {
+    auto result = bonc::solvePortfolio(cnf.clauses, cnf.xors,
+                                       cnf.variable_count, portfolio,
+                                       timeLimit(vm));
+    printPortfolioStats(result);
+    if (result.status == bonc::SolveStatus::Unknown) {
+      std::println("UNKNOWN");
+      return 2;
+    }
+    if (result.status == bonc::SolveStatus::Satisfiable) {
+      values = std::move(result.values);
+    }
+  } else {
+    CMSat::SATSolver solver;
+    if (auto threads = vm["solver-threads"].as<unsigned>(); threads > 1) {
+      solver.set_num_threads(threads);
+    }
+    bonc::load(solver, cnf.clauses, cnf.xors, cnf.variable_count);
+    values = bonc::solve(solver);
+  }
+  std::println("Solving time: {}, peak mem: {}kB",
+               timer.elapsed_as<std::chrono::milliseconds>(),
+               bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
+  if (!values) {
+    std::println("UNSATISFIABLE");
+    return 1;
+  }
+  std::println("SATISFIABLE");
+  std::print("v");
+  for (auto i = 1uz; i < values->size(); i++) {
+    if (values->at(i) == bonc::SolvedModelValue::True) {
+      std::print(" {}", i);
+    } else if (values->at(i) == bonc::SolvedModelValue::False) {
+      std::print(" -{}", i);
+    }
+  }
+  std::println(" 0");
+  return 0;
+}
+
+/**
+ * @brief Time the templates of random permutation S-boxes of each width up
+ * to `max_width`: the table, its cover and espresso.
+ */
+void benchmarkTemplates(std::size_t max_width) {
+  std::mt19937_64 rng{0};
+  for (auto width = 3uz; width <= max_width; width++) {
+    std::vector<std::uint64_t> values(1uz << width);
+    std::iota(values.begin(), values.end(), 0);
+    std::ranges::shuffle(values, rng);
+    auto table = bonc::LookupTable::create(std::format("random{}", width),
+                                           width, width, values);
+    for (auto type : {Modeller::ModellingType::DDT,
+                      Modeller::ModellingType::LAT}) {
+      Modeller modeller{type};
+      bonc::backend_common::Timer timer;
+      auto entries = modeller.differential() ? table->getSparseDDT().size()
+                                             : table->getSparseLAT().size();
+      auto table_time = timer.elapsed_as<std::chrono::milliseconds>();
+      timer.reset();
+      auto cover = modeller.tableTemplateCover(table.get());
+      auto cover_time = timer.elapsed_as<std::chrono::milliseconds>();
+      timer.reset();
+      auto template_ = bonc::sat_modeller::SATModel::buildTableTemplate(cover);
+      std::println(
+          "{}-bit {}: entries: {}, clauses: {}, table: {}, cover: {}, "
+          "espresso: {}",
+          width, modeller.differential() ? "DDT" : "LAT", entries,
+          template_.size(), table_time, cover_time,
+          timer.elapsed_as<std::chrono::milliseconds>());
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   bool is_differential = false;
   bool is_linear = false;
   bool solve = false;
+  bool matsui = false;
+  bool simplify = false;
+  bool active_sbox_bound = false;
 
   po::options_description desc("Allowed options");
   // clang-format off
   desc.add_options()
     ("help", "Print help message")
-    ("input", po::value<std::string>()->required(), "Input file containing the frontend result in JSON format")
+    ("input", po::value<std::string>(), "Input file containing the frontend result in JSON format")
     ("differential,d", po::bool_switch(&is_differential), "Construct differential propagation model")
     ("linear,l", po::bool_switch(&is_linear), "Construct linear propagation model")
     ("input-bits,I", po::value<std::string>()->default_value(""), "BONC Input bits' name, format \"name1,name2...\"")
     ("max-weight,w", po::value<int>(), "Max weight (probability or correlation) allowed; defaults to input size / 2 for linear, input size for differential")
-    ("output", po::value<std::string>(), "Output file to write the model in DIMACS format")
+    ("model-threads", po::value<std::size_t>()->default_value(1), "Threads building the model, each one from a slice of the outputs; the model only depends on this count")
+    ("benchmark-templates", po::value<std::size_t>(), "Time building the DDT and LAT templates of random S-boxes of widths 3 up to this one, then exit")
+    ("espresso-workers", po::value<std::size_t>()->default_value(0), "Worker processes minimising the S-box templates of all tables concurrently before modelling; 0 builds each one when first needed")
+    ("output", po::value<std::string>(), "Output file to write the model in DIMACS format, compressed if it ends with .gz or .xz")
+    ("output-threads", po::value<std::size_t>()->default_value(1), "Threads formatting the DIMACS output; more than one buffers the model in memory")
+    ("load-dimacs", po::value<std::string>(), "Solve a saved DIMACS model (optionally .gz or .xz) instead of building one from JSON")
     ("solve", po::bool_switch(&solve), "Solve the model using cryptominisat5")
+    ("portfolio", po::value<std::size_t>()->default_value(0), "Race this many diversified CryptoMiniSat instances on the model, the first answer wins")
+    ("portfolio-external", po::value<std::string>(), "External solvers found on PATH to join the portfolio, format \"kissat,cadical...\"; they read the model as a DIMACS file")
+    ("solver-threads", po::value<unsigned>()->default_value(1), "CryptoMiniSat's own threads per solver instance")
+    ("time-limit", po::value<double>(), "Give up solving after this many seconds, reporting UNKNOWN; not with --optimize, --enumerate or Matsui's round bounds")
+    ("optimize", po::value<std::string>()->implicit_value("linear"), "Search the minimum weight within one solver by tightening the weight bound: \"linear\" (descent), \"binary\" or \"ascend\"; implies --solve and an incremental --cardinality")
+    ("active-sbox-bound", po::bool_switch(&active_sbox_bound), "Bound the weight from below by a truncated model counting active S-boxes first; --optimize then starts from this bound")
+    ("matsui", po::bool_switch(&matsui), "Search the optimal weight of 1, 2, ... rounds in turn within one solver, pruned by Matsui's bounds from fewer rounds; implies --solve")
+    ("round-weights", po::value<std::string>(), "Known optimal weights of 1, 2, ... rounds, format \"w1,w2...\"; adds Matsui's bounds to the model")
+    ("round-weights-cache", po::value<std::string>(), "File caching optimal weights of fewer rounds across --matsui runs")
+    ("enumerate", po::value<std::size_t>(), "After solving, enumerate all trails with the same input and output values up to the found weight plus this much, and sum up their probability; implies --solve and an incremental --cardinality")
+    ("enumerate-threads", po::value<std::size_t>()->default_value(1), "Threads enumerating trails, splitting the search by S-box activity")
+    ("enumerate-limit", po::value<std::size_t>()->default_value(0), "Stop enumerating after this many trails, 0 for no limit")
+    ("simplify", po::bool_switch(&simplify), "Simplify the model before writing or solving it: propagate units, substitute equivalent variables and drop unused ones")
+    ("xor", po::value<std::string>()->default_value("native"), "XOR constraint encoding: \"native\" (CryptoMiniSat XOR clauses) or \"cnf\"; native by default, except for --output and external solvers, which get plain CNF unless --xor native writes 'x' lines")
+    ("xor-cut-width", po::value<std::size_t>()->default_value(bonc::sat_modeller::SATModel::DEFAULT_XOR_CUT_WIDTH), "Max operands per CNF chunk of a cut XOR constraint with --xor cnf, 0 to disable cutting")
+    ("cardinality", po::value<std::string>()->default_value("seqcounter"), "Encoding of the weight bound: \"seqcounter\", \"totalizer\", \"mtotalizer\" (modulo totalizer) or \"cardnetwork\" (cardinality network); \"all\" builds the model with each in turn and compares their size and, with --solve, solving time")
     ("print-states", po::value<std::string>()->default_value(".*"), "A regex pattern to filter state variable solutions to print")
   ;
   // clang-format on
@@ -363,6 +1759,82 @@ int main(int argc, char** argv) {
     return 0;
   }
 
+  if (vm.count("benchmark-templates")) {
+    benchmarkTemplates(vm["benchmark-templates"].as<std::size_t>());
+    return 0;
+  }
+  if (vm.count("load-dimacs")) {
+    return solveDIMACS(vm["load-dimacs"].as<std::string>(), vm);
+  }
+  if (!vm.count("input")) {
+    throw std::runtime_error("No input file specified");
+  }
+
+  std::optional<OptimizeStrategy> optimize;
+  if (vm.count("optimize")) {
+    auto strategy = vm["optimize"].as<std::string>();
+    if (strategy == "linear") {
+      optimize = OptimizeStrategy::Linear;
+    } else if (strategy == "binary") {
+      optimize = OptimizeStrategy::Binary;
+    } else if (strategy == "ascend") {
+      optimize = OptimizeStrategy::Ascend;
+    } else {
+      throw std::runtime_error(
+          "--optimize must be one of \"linear\", \"binary\" or \"ascend\"");
+    }
+    solve = true;
+  }
+  auto round_bounds = matsui || vm.count("round-weights")
+                   || vm.count("round-weights-cache");
+  if (round_bounds && optimize) {
+    throw std::runtime_error(
+        "--optimize cannot be combined with Matsui's round bounds");
+  }
+  auto enumerate = vm.count("enumerate") > 0;
+  if (round_bounds && enumerate) {
+    throw std::runtime_error(
+        "--enumerate cannot be combined with Matsui's round bounds");
+  }
+  auto enumerate_threads = vm["enumerate-threads"].as<std::size_t>();
+  if (simplify && (optimize || round_bounds || enumerate)) {
+    // these add clauses and assumptions over the variables as modelled
+    throw std::runtime_error(
+        "--simplify cannot be combined with --optimize, --enumerate or "
+        "Matsui's round bounds");
+  }
+  solve = solve || matsui || enumerate;
+  if (vm.count("time-limit") && (optimize || round_bounds || enumerate)) {
+    // these run many solves, with no UNKNOWN for the whole search to report
+    throw std::runtime_error(
+        "--time-limit cannot be combined with --optimize, --enumerate or "
+        "Matsui's round bounds");
+  }
+  auto portfolio =
+      solve ? buildPortfolio(vm) : std::vector<bonc::PortfolioEntry>{};
+  if (!portfolio.empty() && (optimize || round_bounds || enumerate)) {
+    throw std::runtime_error(
+        "A solver portfolio cannot be combined with --optimize, --enumerate "
+        "or Matsui's round bounds");
+  }
+  std::vector<std::size_t> best_weights{0};
+  if (vm.count("round-weights")) {
+    std::vector<std::string> weights;
+    boost::split(weights, vm["round-weights"].as<std::string>(),
+                 boost::is_any_of(","));
+    for (auto& weight : weights) {
+      best_weights.push_back(std::stoul(weight));
+    }
+  }
+  std::string cache_path;
+  if (vm.count("round-weights-cache")) {
+    cache_path = vm["round-weights-cache"].as<std::string>();
+    auto cached = readRoundWeights(cache_path);
+    if (cached.size() > best_weights.size()) {
+      best_weights = std::move(cached);
+    }
+  }
+
   std::string input_file = vm["input"].as<std::string>();
 
   std::ifstream ifs(input_file);
@@ -375,7 +1847,119 @@ int main(int argc, char** argv) {
   auto modelling_type =
       is_linear ? Modeller::ModellingType::LAT : Modeller::ModellingType::DDT;
 
-  Modeller modeller(modelling_type);
+  // Clauses are streamed into the DIMACS file and/or the solver while
+  // modelling, so the CNF is never materialised in memory unless the output
+  // is compressed or formatted by several threads.
+  bonc::sat_modeller::TeeClauseSink sinks;
+  std::optional<bonc::sat_modeller::DimacsFileSink> file_sink;
+  std::optional<bonc::sat_modeller::MemoryClauseSink> memory_sink;
+  bonc::sat_modeller::dimacs::WriterOptions writer_options;
+  if (vm.count("output")) {
+    auto out_file = vm["output"].as<std::string>();
+    writer_options.threads = vm["output-threads"].as<std::size_t>();
+    writer_options.compression =
+        bonc::sat_modeller::dimacs::compressionFromPath(out_file);
+    if (simplify || writer_options.threads > 1
+        || writer_options.compression
+               != bonc::sat_modeller::dimacs::Compression::None) {
+      memory_sink.emplace();
+    } else {
+      file_sink.emplace(out_file);
+      sinks.add(*file_sink);
+    }
+  }
+  std::optional<CMSat::SATSolver> solver;
+  std::optional<bonc::CMSatClauseSink> solver_sink;
+  if (solve && !portfolio.empty()) {
+    // every portfolio member loads the model on its own
+    memory_sink.emplace();
+  } else if (solve) {
+    solver.emplace();
+    if (auto threads = vm["solver-threads"].as<unsigned>(); threads > 1) {
+      solver->set_num_threads(threads);
+    }
+    if (simplify) {
+      // the solver gets the simplified CNF instead
+      memory_sink.emplace();
+    } else {
+      solver_sink.emplace(*solver);
+      sinks.add(*solver_sink);
+    }
+    if (enumerate && enumerate_threads > 1) {
+      // enumeration workers load the model on their own
+      memory_sink.emplace();
+    }
+  }
+  if (memory_sink) {
+    sinks.add(*memory_sink);
+  }
+
+  Modeller modeller(modelling_type, sinks);
+  auto xor_encoding = vm["xor"].as<std::string>();
+  // other solvers do not read the `x` lines of native XOR constraints
+  auto needs_cnf = std::ranges::any_of(portfolio, [](auto& entry) {
+    return !entry.command.empty()
+        && !entry.command.front().ends_with("cryptominisat5");
+  });
+  if (xor_encoding == "native" && needs_cnf) {
+    if (!vm["xor"].defaulted()) {
+      throw std::runtime_error(
+          "External solvers in the portfolio need --xor cnf");
+    }
+    xor_encoding = "cnf";
+  }
+  // and neither do most readers of the written file, so `x` lines are only
+  // written when asked for
+  if (xor_encoding == "native" && vm.count("output")
+      && vm["xor"].defaulted()) {
+    xor_encoding = "cnf";
+  }
+  if (xor_encoding == "native") {
+    modeller.model.setXorEncoding(bonc::sat_modeller::XorEncoding::Native);
+  } else if (xor_encoding == "cnf") {
+    auto cut_width = vm["xor-cut-width"].as<std::size_t>();
+    if (cut_width != 0 && cut_width < 3) {
+      throw std::runtime_error("--xor-cut-width must be 0 or at least 3");
+    }
+    modeller.model.setXorEncoding(bonc::sat_modeller::XorEncoding::Cnf,
+                                  cut_width);
+  } else {
+    throw std::runtime_error("--xor must be either \"native\" or \"cnf\"");
+  }
+
+  auto compare_cardinality = vm["cardinality"].as<std::string>() == "all";
+  if (compare_cardinality
+      && (vm.count("output") || optimize || round_bounds || enumerate
+          || vm.count("time-limit") || !portfolio.empty())) {
+    throw std::runtime_error(
+        "--cardinality all cannot be combined with --output, --optimize, "
+        "--enumerate, --time-limit, a solver portfolio or Matsui's round "
+        "bounds");
+  }
+  auto cardinality_encoding =
+      compare_cardinality
+          ? bonc::sat_modeller::CardinalityEncoding::SequentialCounter
+          : bonc::sat_modeller::parseCardinalityEncoding(
+                vm["cardinality"].as<std::string>());
+  if (!cardinality_encoding) {
+    throw std::runtime_error(
+        "--cardinality must be one of \"seqcounter\", \"totalizer\", "
+        "\"mtotalizer\", \"cardnetwork\" or \"all\"");
+  }
+  if ((optimize || enumerate)
+      && *cardinality_encoding
+             == bonc::sat_modeller::CardinalityEncoding::SequentialCounter) {
+    if (!vm["cardinality"].defaulted()) {
+      throw std::runtime_error(
+          "--optimize and --enumerate need an incremental --cardinality "
+          "encoding");
+    }
+    cardinality_encoding = bonc::sat_modeller::CardinalityEncoding::Totalizer;
+  }
+  modeller.setCardinalityEncoding(*cardinality_encoding);
+  if (round_bounds) {
+    modeller.enableRoundBounds();
+  }
 
   std::vector<std::string> input_names;
   boost::split(input_names, vm["input-bits"].as<std::string>(),
@@ -387,85 +1971,229 @@ int main(int argc, char** argv) {
   modeller.addInputNames(input_names);
 
   auto [inputs, iterations, outputs] = parser.parseAll();
+  modeller.setIterations(iterations);
+  std::optional<std::size_t> max_weight;
+  if (vm.count("max-weight")) {
+    max_weight = vm["max-weight"].as<int>();
+    if (max_weight <= 0) {
+      throw std::runtime_error("--max-weight must be positive");
+    }
+  }
+  if (compare_cardinality) {
+    compareCardinalityEncodings(modelling_type, input_names, outputs,
+                                max_weight, modeller.model.getXorEncoding(),
+                                modeller.model.getXorCutWidth(), solve);
+    return 0;
+  }
+  std::size_t lower_bound = 0;
+  if (active_sbox_bound) {
+    auto bound = activeSBoxBound(is_linear ? Modeller::ModellingType::ActiveLAT
+                                           : Modeller::ModellingType::ActiveDDT,
+                                 input_names, outputs, max_weight);
+    if (!bound) {
+      std::println("UNSATISFIABLE");
+      return 1;
+    }
+    lower_bound = *bound;
+  }
   // auto debug_outputs = *std::ranges::find_if(
   //     iterations, [](auto& target) { return target->getName() == "3/5"; });
   // for (auto& expr : debug_outputs->update_expressions) {
   //   modeller.traverse(expr);
   // }
   bonc::backend_common::Timer timer;
+  std::vector<bonc::Ref<bonc::BitExpr>> output_exprs;
   for (auto& info : outputs) {
     std::cout << "Output: " << info.name << ", Size: " << info.size << "\n";
-    for (auto& expr : info.expressions) {
-      modeller.traverse(expr);
-    }
+    output_exprs.append_range(info.expressions);
   }
-  std::optional<std::size_t> max_weight;
-  if (vm.count("max-weight")) {
-    max_weight = vm["max-weight"].as<int>();
-    if (max_weight <= 0) {
-      throw std::runtime_error("--max-weight must be positive");
+  if (auto workers = vm["espresso-workers"].as<std::size_t>()) {
+    bonc::sat_modeller::EspressoPool pool{workers};
+    modeller.buildTableTemplates(output_exprs, pool);
+    std::println("Template time: {}",
+                 timer.elapsed_as<std::chrono::milliseconds>());
+  }
+  std::vector<bonc::sat_modeller::Variable> output_vars;
+  if (auto threads = vm["model-threads"].as<std::size_t>(); threads > 1) {
+    output_vars = modeller.traverseParallel(output_exprs, threads);
+  } else {
+    for (auto& expr : output_exprs) {
+      output_vars.push_back(modeller.traverse(expr));
     }
   }
   modeller.complete(max_weight);
   std::println("Modelling time: {}, peak mem: {}kB",
                timer.elapsed_as<std::chrono::milliseconds>(),
                bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
-  std::println("Model variables: {}, clauses: {}",
-               modeller.model.variableSize(),
-               modeller.model.getClauses().size());
+  std::println("Model variables: {}, clauses: {}, xors: {}",
+               modeller.model.variableSize(), modeller.model.clauseSize(),
+               modeller.model.xorSize());
+  std::println("Model memory: names: {}kB, memo: {}kB",
+               modeller.model.nameMemoryUsage() / 1024,
+               modeller.memoryUsage() / 1024);
+  if (auto& bound = modeller.getWeightBound()) {
+    std::println("Weight bound ({}): variables: {}, clauses: {}",
+                 bonc::sat_modeller::cardinalityEncodingName(
+                     bound->getEncoding()),
+                 bound->auxVariables(), bound->auxClauses());
+  }
+  if (round_bounds) {
+    std::println("Rounds: {}", modeller.roundSize());
+  }
 
-  if (vm.count("output")) {
-    auto out_file = vm["output"].as<std::string>();
-    std::ofstream ofs(out_file);
-    modeller.model.printDIMACS(ofs);
+  // what is written and solved, if not streamed while modelling
+  const bonc::sat_modeller::ClauseArena* clauses = nullptr;
+  const bonc::sat_modeller::XorArena* xors = nullptr;
+  auto variable_count = modeller.model.variableSize() - 1;
+  if (memory_sink) {
+    clauses = &memory_sink->getClauses();
+    xors = &memory_sink->getXors();
+  }
+  std::optional<bonc::sat_modeller::SimplifiedCNF> simplified;
+  if (simplify) {
+    timer.reset();
+    simplified =
+        bonc::sat_modeller::simplify(*clauses, *xors, variable_count);
+    std::println("Simplifying time: {}",
+                 timer.elapsed_as<std::chrono::milliseconds>());
+    std::println(
+        "Simplified variables: {} -> {} (fixed: {}, equivalent: {}, free: "
+        "{}), clauses: {} -> {}, xors: {} -> {}",
+        variable_count, simplified->variable_count, simplified->fixedSize(),
+        simplified->equivalentSize(), simplified->freeSize(), clauses->size(),
+        simplified->clauses.size(), xors->size(), simplified->xors.size());
+    clauses = &simplified->clauses;
+    xors = &simplified->xors;
+    variable_count = simplified->variable_count;
+    if (solver) {
+      bonc::load(*solver, *clauses, *xors, variable_count);
+    }
   }
 
-  if (solve) {
+  if (memory_sink && vm.count("output") && !file_sink) {
     timer.reset();
-    auto values = bonc::solve(modeller.model);
-    std::println("Solving time: {}, peak mem: {}kB",
+    bonc::sat_modeller::dimacs::write(vm["output"].as<std::string>(),
+                                      *clauses, *xors, variable_count,
+                                      writer_options);
+    std::println("Writing time: {}",
+                 timer.elapsed_as<std::chrono::milliseconds>());
+  }
+
+  if (!solve) {
+    return 0;
+  }
+
+  auto state_name_regex = boost::regex(vm["print-states"].as<std::string>());
+  auto report = [&](const std::vector<bonc::SolvedModelValue>& values) {
+    std::println("{}: 2^-{}", is_differential ? "Probability" : "Correlation",
+                 modeller.getWeight(values));
+    printTrail(parser, std::views::concat(inputs, iterations), modeller,
+               values, state_name_regex);
+  };
+
+  // the written model stops at the initial bound, clauses added while
+  // searching only go to the solver, and to the enumeration workers
+  if (file_sink) {
+    sinks.remove(*file_sink);
+  }
+  if (memory_sink && !enumerate) {
+    sinks.remove(*memory_sink);
+  }
+  auto enumerateFrom = [&](const std::vector<bonc::SolvedModelValue>& trail) {
+    timer.reset();
+    auto hull = enumerateHull(*solver, modeller,
+                              memory_sink ? &*memory_sink : nullptr, trail,
+                              output_vars, vm["enumerate"].as<std::size_t>(),
+                              enumerate_threads,
+                              vm["enumerate-limit"].as<std::size_t>());
+    std::println("Enumerating time: {}, peak mem: {}kB",
                  timer.elapsed_as<std::chrono::milliseconds>(),
                  bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
-    if (!values) {
+    printTrailHull(hull, is_differential);
+  };
+
+  if (matsui) {
+    timer.reset();
+    auto weight = searchRoundByRound(*solver, modeller, best_weights,
+                                     cache_path, report);
+    std::println("Searching time: {}, peak mem: {}kB",
+                 timer.elapsed_as<std::chrono::milliseconds>(),
+                 bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
+    if (!weight) {
       std::println("UNSATISFIABLE");
       return 1;
     }
-    std::println("SATISFIABLE");
+    std::println("Optimal {}: 2^-{}",
+                 is_differential ? "probability" : "correlation", *weight);
+    return 0;
+  }
 
-    // modeller.debugSolution(*values);
+  if (optimize) {
+    timer.reset();
+    std::vector<bonc::SolvedModelValue> best_trail;
+    auto weight =
+        optimizeWeight(
+            *solver, modeller, *optimize,
+            [&](auto& values) {
+              report(values);
+              best_trail = values;
+            },
+            lower_bound);
+    std::println("Optimizing time: {}, peak mem: {}kB",
+                 timer.elapsed_as<std::chrono::milliseconds>(),
+                 bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
+    if (!weight) {
+      std::println("UNSATISFIABLE");
+      return 1;
+    }
+    std::println("Optimal {}: 2^-{}",
+                 is_differential ? "probability" : "correlation", *weight);
+    if (enumerate) {
+      enumerateFrom(best_trail);
+    }
+    return 0;
+  }
 
-    std::size_t weight = 0;
-    for (auto var : modeller.getWeightVars()) {
-      auto var_index = var.getIndex();
-      if (values->at(var_index) == bonc::SolvedModelValue::True) {
-        weight++;
-      }
+  std::vector<bonc::sat_modeller::Literal> assumptions;
+  if (round_bounds && modeller.roundSize() > 0) {
+    // unknown weights of fewer rounds are bounded by 0
+    auto best = best_weights;
+    best.resize(std::max(best.size(), modeller.roundSize()), 0);
+    assumptions = modeller.assumeMatsuiBounds(
+        modeller.roundSize(), modeller.getWeightLimit(), best);
+  }
+  timer.reset();
+  std::optional<std::vector<bonc::SolvedModelValue>> values;
+  if (!portfolio.empty()) {
+    auto result = bonc::solvePortfolio(*clauses, *xors, variable_count,
+                                       portfolio, timeLimit(vm));
+    printPortfolioStats(result);
+    if (result.status == bonc::SolveStatus::Unknown) {
+      std::println("UNKNOWN");
+      return 2;
     }
-    std::println("{}: 2^-{}", is_differential ? "Probability" : "Correlation",
-                 weight);
+    if (result.status == bonc::SolveStatus::Satisfiable) {
+      values = std::move(result.values);
+    }
+  } else {
+    values = bonc::solve(*solver, assumptions);
+  }
+  std::println("Solving time: {}, peak mem: {}kB",
+               timer.elapsed_as<std::chrono::milliseconds>(),
+               bonc::backend_common::peak_rss_bytes().value_or(0) / 1024);
+  if (!values) {
+    std::println("UNSATISFIABLE");
+    return 1;
+  }
+  std::println("SATISFIABLE");
+  if (simplified) {
+    values = bonc::expand(*simplified, *values);
+  }
 
-    auto state_name_regex = boost::regex(vm["print-states"].as<std::string>());
+  // modeller.debugSolution(*values);
 
-    std::println("### print-state begin");
-    for (bonc::Ref<bonc::ReadTarget>& target :
-         std::views::concat(inputs, iterations)) {
-      auto& name = target->getName();
-      if (!boost::regex_match(name, state_name_regex)) {
-        continue;
-      }
-      std::println("# State {}: ", name);
-      std::vector<bonc::SolvedModelValue> state_values;
-      for (auto index : std::views::iota(0uz, target->getSize() * CHAR_BIT)) {
-        auto expr = parser.createExpr<bonc::ReadBitExpr>(target, index);
-        auto var_index = modeller.getExprIndex(expr);
-        if (var_index <= 0) {
-          state_values.push_back(bonc::SolvedModelValue::Undefined);
-          continue;
-        }
-        state_values.push_back(values->at(var_index));
-      }
-      printStateValue(state_values);
-    }
-    std::println("### print-state end");
+  report(*values);
+  if (enumerate) {
+    enumerateFrom(*values);
   }
-}
\ No newline at end of file
+}
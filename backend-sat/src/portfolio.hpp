@@ -0,0 +1,391 @@
+#pragma once
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <print>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <cmsat_adapter.hpp>
+#include <dimacs.h>
+#include <perf.h>
+
+extern char** environ;
+
+namespace bonc {
+
+enum class SolveStatus { Satisfiable, Unsatisfiable, Unknown };
+
+inline std::string_view solveStatusName(SolveStatus status) {
+  switch (status) {
+    case SolveStatus::Satisfiable: return "SATISFIABLE";
+    case SolveStatus::Unsatisfiable: return "UNSATISFIABLE";
+    default: return "UNKNOWN";
+  }
+}
+
+/**
+ * @brief Member of a solver portfolio: an in-process CryptoMiniSat instance
+ * tuned by `configure`, or, if `command` is set, an external binary speaking
+ * the SAT competition output format, run as `command... <dimacs file>`.
+ */
+struct PortfolioEntry {
+  std::string name;
+  std::function<void(CMSat::SATSolver&)> configure;
+  std::vector<std::string> command;
+};
+
+struct PortfolioEntryStats {
+  std::string name;
+  SolveStatus status{SolveStatus::Unknown};
+  std::chrono::milliseconds time{0};
+};
+
+struct PortfolioResult {
+  SolveStatus status{SolveStatus::Unknown};
+  std::optional<std::size_t> winner;
+  std::vector<SolvedModelValue> values;
+  std::vector<PortfolioEntryStats> stats;
+};
+
+/**
+ * @brief `count` CryptoMiniSat configurations, diversified by default
+ * polarity, inprocessing and Gauss-Jordan elimination, and seeded with their
+ * position so that no two of them search alike.
+ *
+ * @param threads CryptoMiniSat's own threads per instance.
+ */
+inline std::vector<PortfolioEntry> cmsatPortfolio(std::size_t count,
+                                                  unsigned threads = 1) {
+  using Configure = void (*)(CMSat::SATSolver&);
+  static const std::pair<std::string_view, Configure> VARIANTS[] = {
+      {"default", [](CMSat::SATSolver&) {}},
+      {"polarity-false",
+       [](CMSat::SATSolver& solver) { solver.set_default_polarity(false); }},
+      {"gauss",
+       [](CMSat::SATSolver& solver) { solver.set_allow_otf_gauss(); }},
+      {"no-simplify",
+       [](CMSat::SATSolver& solver) { solver.set_no_simplify(); }},
+      {"no-bve-bva",
+       [](CMSat::SATSolver& solver) {
+         solver.set_no_bve();
+         solver.set_no_bva();
+       }},
+      {"no-eq-replace",
+       [](CMSat::SATSolver& solver) {
+         solver.set_no_equivalent_lit_replacement();
+       }},
+  };
+  std::vector<PortfolioEntry> entries;
+  for (auto i = 0uz; i < count; i++) {
+    auto [name, configure] = VARIANTS[i % std::size(VARIANTS)];
+    // later laps repeat the variants with the opposite polarity default
+    auto flipped = i / std::size(VARIANTS) % 2 == 1;
+    entries.push_back(PortfolioEntry{
+        .name = flipped ? std::format("{}+polarity-true", name)
+                        : std::string(name),
+        .configure =
+            [configure, flipped, threads, i](CMSat::SATSolver& solver) {
+              if (threads > 1) {
+                solver.set_num_threads(threads);
+              }
+              solver.set_seed(static_cast<std::uint32_t>(i));
+              configure(solver);
+              if (flipped) {
+                solver.set_default_polarity(true);
+              }
+            },
+    });
+  }
+  return entries;
+}
+
+/**
+ * @brief Look `name` up on PATH, unless it already contains a '/'.
+ */
+inline std::optional<std::string> findExecutable(const std::string& name) {
+  if (name.contains('/')) {
+    return ::access(name.c_str(), X_OK) == 0 ? std::optional{name}
+                                             : std::nullopt;
+  }
+  auto path = std::getenv("PATH");
+  if (!path) {
+    return std::nullopt;
+  }
+  for (auto dir : std::views::split(std::string_view{path}, ':')) {
+    auto candidate = std::filesystem::path(std::string_view{dir}) / name;
+    if (::access(candidate.c_str(), X_OK) == 0) {
+      return candidate.string();
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Entry for an external solver binary, e.g. kissat, cadical or
+ * cryptominisat5, or nothing if it is not found.
+ *
+ * Only cryptominisat5 reads the `x` lines of native XOR constraints.
+ */
+inline std::optional<PortfolioEntry> externalSolver(const std::string& name) {
+  auto path = findExecutable(name);
+  if (!path) {
+    return std::nullopt;
+  }
+  PortfolioEntry entry{.name = name, .command = {*path}};
+  if (std::filesystem::path(name).filename() == "cryptominisat5") {
+    entry.command.push_back("--verb=0");
+  }
+  return entry;
+}
+
+namespace detail {
+
+inline std::vector<SolvedModelValue> cmsatModel(CMSat::SATSolver& solver) {
+  return solver.get_model() | std::views::transform([](auto lit) {
+           return static_cast<SolvedModelValue>(lit.getValue());
+         })
+       | std::ranges::to<std::vector>();
+}
+
+/**
+ * @brief Parse `s` and `v` lines of the SAT competition output format.
+ */
+inline std::pair<SolveStatus, std::vector<SolvedModelValue>>
+parseCompetitionOutput(std::string_view output, std::size_t variable_count) {
+  auto status = SolveStatus::Unknown;
+  std::vector<SolvedModelValue> values(variable_count + 1,
+                                       SolvedModelValue::Undefined);
+  for (auto range : std::views::split(output, '\n')) {
+    std::string_view line{range};
+    if (line.starts_with("s ")) {
+      if (line.substr(2).starts_with("SATISFIABLE")) {
+        status = SolveStatus::Satisfiable;
+      } else if (line.substr(2).starts_with("UNSATISFIABLE")) {
+        status = SolveStatus::Unsatisfiable;
+      }
+    } else if (line.starts_with("v ")) {
+      auto ptr = line.data() + 2;
+      auto end = line.data() + line.size();
+      while (ptr < end) {
+        if (*ptr == ' ') {
+          ptr++;
+          continue;
+        }
+        long lit;
+        auto [next, ec] = std::from_chars(ptr, end, lit);
+        if (ec != std::errc{}) {
+          break;
+        }
+        ptr = next;
+        auto var = static_cast<std::size_t>(std::abs(lit));
+        if (var != 0 && var < values.size()) {
+          values[var] =
+              lit > 0 ? SolvedModelValue::True : SolvedModelValue::False;
+        }
+      }
+    }
+  }
+  if (status != SolveStatus::Satisfiable) {
+    values.clear();
+  }
+  return {status, std::move(values)};
+}
+
+}  // namespace detail
+
+/**
+ * @brief Race all `entries` on the same CNF; the first definite answer wins
+ * and cancels the others, as does `time_limit`.
+ *
+ * In-process solvers load the clauses in their own threads. External ones
+ * share a temporary DIMACS file.
+ */
+inline PortfolioResult solvePortfolio(
+    const bonc::sat_modeller::ClauseArena& clauses,
+    const bonc::sat_modeller::XorArena& xors, std::size_t variable_count,
+    std::span<const PortfolioEntry> entries,
+    std::optional<std::chrono::milliseconds> time_limit = std::nullopt) {
+  PortfolioResult result;
+  result.stats.resize(entries.size());
+
+  std::mutex mutex;
+  std::condition_variable finished;
+  auto running = entries.size();
+  bool cancelled = false;
+  std::vector<CMSat::SATSolver*> solvers(entries.size(), nullptr);
+  std::vector<pid_t> pids(entries.size(), 0);
+  // call with `mutex` held
+  auto cancel = [&] {
+    cancelled = true;
+    for (auto solver : solvers) {
+      if (solver) {
+        solver->interrupt_asap();
+      }
+    }
+    for (auto pid : pids) {
+      if (pid > 0) {
+        ::kill(pid, SIGKILL);
+      }
+    }
+  };
+
+  std::filesystem::path cnf_path;
+  if (std::ranges::any_of(
+          entries, [](auto& entry) { return !entry.command.empty(); })) {
+    cnf_path = std::filesystem::temp_directory_path()
+             / std::format("bonc-portfolio-{}.cnf", ::getpid());
+    bonc::sat_modeller::dimacs::write(cnf_path.string(), clauses, xors,
+                                      variable_count);
+  }
+
+  auto solveInProcess = [&](std::size_t index)
+      -> std::pair<SolveStatus, std::vector<SolvedModelValue>> {
+    CMSat::SATSolver solver;
+    entries[index].configure(solver);
+    load(solver, clauses, xors, variable_count);
+    {
+      std::lock_guard lock{mutex};
+      if (cancelled) {
+        return {SolveStatus::Unknown, {}};
+      }
+      solvers[index] = &solver;
+    }
+    auto ret = solver.solve();
+    {
+      std::lock_guard lock{mutex};
+      solvers[index] = nullptr;
+    }
+    if (ret == CMSat::l_True) {
+      return {SolveStatus::Satisfiable, detail::cmsatModel(solver)};
+    } else if (ret == CMSat::l_False) {
+      return {SolveStatus::Unsatisfiable, {}};
+    }
+    return {SolveStatus::Unknown, {}};
+  };
+
+  auto solveExternal = [&](std::size_t index)
+      -> std::pair<SolveStatus, std::vector<SolvedModelValue>> {
+    // close-on-exec, so concurrently spawned solvers do not keep the write
+    // end open
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) != 0) {
+      throw std::runtime_error("Failed to create pipe");
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+    auto args = entries[index].command;
+    args.push_back(cnf_path.string());
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+      argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    pid_t pid;
+    auto error = ::posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(),
+                               environ);
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(fds[1]);
+    if (error != 0) {
+      ::close(fds[0]);
+      throw std::runtime_error(
+          std::format("Failed to run {}", entries[index].name));
+    }
+    {
+      std::lock_guard lock{mutex};
+      pids[index] = pid;
+      if (cancelled) {
+        ::kill(pid, SIGKILL);
+      }
+    }
+    std::string output;
+    char buffer[1 << 16];
+    ssize_t size;
+    while ((size = ::read(fds[0], buffer, sizeof(buffer))) != 0) {
+      if (size < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      output.append(buffer, size);
+    }
+    ::close(fds[0]);
+    // wait for the exit without reaping, so the pid stays the child's while
+    // `cancel` may still signal it, then reap under the lock, which no
+    // longer blocks
+    siginfo_t info;
+    while (::waitid(P_PID, pid, &info, WEXITED | WNOWAIT) != 0
+           && errno == EINTR) {
+    }
+    {
+      std::lock_guard lock{mutex};
+      ::waitpid(pid, nullptr, 0);
+      pids[index] = 0;
+    }
+    return detail::parseCompetitionOutput(output, variable_count);
+  };
+
+  {
+    std::vector<std::jthread> workers;
+    for (auto i = 0uz; i < entries.size(); i++) {
+      workers.emplace_back([&, i] {
+        bonc::backend_common::Timer timer;
+        std::pair<SolveStatus, std::vector<SolvedModelValue>> answer{
+            SolveStatus::Unknown, {}};
+        try {
+          answer = entries[i].command.empty() ? solveInProcess(i)
+                                              : solveExternal(i);
+        } catch (const std::exception& e) {
+          std::println(stderr, "{}: {}", entries[i].name, e.what());
+        }
+        std::lock_guard lock{mutex};
+        result.stats[i] = {entries[i].name, answer.first,
+                           timer.elapsed_as<std::chrono::milliseconds>()};
+        if (answer.first != SolveStatus::Unknown && !result.winner) {
+          result.status = answer.first;
+          result.winner = i;
+          result.values = std::move(answer.second);
+          cancel();
+        }
+        running--;
+        finished.notify_all();
+      });
+    }
+    std::unique_lock lock{mutex};
+    auto all_finished = [&] { return running == 0; };
+    if (time_limit && !finished.wait_for(lock, *time_limit, all_finished)) {
+      cancel();
+    }
+    finished.wait(lock, all_finished);
+  }
+
+  if (!cnf_path.empty()) {
+    std::filesystem::remove(cnf_path);
+  }
+  return result;
+}
+
+}  // namespace bonc
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace bonc {
+
+/**
+ * @brief Concurrent write-once map where readers block until the key is
+ * published, split into independently locked shards by hash.
+ */
+template <class Key, class Value, class Hash = std::hash<Key>>
+class ShardedMemo {
+private:
+  struct Shard {
+    std::mutex mutex;
+    std::condition_variable published;
+    std::unordered_map<Key, Value, Hash> values;
+  };
+
+  std::size_t shard_count;
+  std::unique_ptr<Shard[]> shards;
+  std::atomic<bool> cancelled{false};
+
+  Shard& shardOf(const Key& key) {
+    return shards[Hash{}(key) % shard_count];
+  }
+
+public:
+  explicit ShardedMemo(std::size_t shard_count = 64)
+      : shard_count{shard_count}, shards{new Shard[shard_count]} {}
+
+  /**
+   * @brief Publish `value` for `key` unless it is already there.
+   */
+  void publish(const Key& key, Value value) {
+    auto& shard = shardOf(key);
+    {
+      std::lock_guard lock{shard.mutex};
+      if (!shard.values.try_emplace(key, std::move(value)).second) {
+        return;
+      }
+    }
+    shard.published.notify_all();
+  }
+
+  /**
+   * @brief Wait until `key` is published.
+   *
+   * @throw std::runtime_error if `cancel` is called meanwhile.
+   */
+  Value wait(const Key& key) {
+    auto& shard = shardOf(key);
+    std::unique_lock lock{shard.mutex};
+    typename std::unordered_map<Key, Value, Hash>::iterator it;
+    shard.published.wait(lock, [&] {
+      it = shard.values.find(key);
+      return it != shard.values.end() || cancelled;
+    });
+    if (it == shard.values.end()) {
+      throw std::runtime_error("Cancelled while waiting for another shard");
+    }
+    return it->second;
+  }
+
+  /**
+   * @brief Wake up all waiters, e.g. when the thread which would publish
+   * their keys has failed.
+   */
+  void cancel() {
+    cancelled = true;
+    for (auto i = 0uz; i < shard_count; i++) {
+      std::lock_guard lock{shards[i].mutex};
+      shards[i].published.notify_all();
+    }
+  }
+};
+
+}  // namespace bonc
@@ -55,10 +55,19 @@ public:
     if (auto it = expr_store.find(expr); it != expr_store.end()) {
       return boost::static_pointer_cast<T>(*it);
     }
+    expr->id = expr_store.size();
     auto [it, suc] = expr_store.insert(std::move(expr));
     return boost::static_pointer_cast<T>(*it);
   }
 
+  /**
+   * @brief Number of distinct expressions, one more than the largest
+   * `BitExpr::getId()` so far.
+   */
+  std::size_t exprCount() const {
+    return expr_store.size();
+  }
+
   FrontendResult parseAll();
 
   Ref<ReadTarget> getReadTarget(const std::string& name) const;
@@ -66,6 +75,11 @@ public:
 };
 
 class BitExpr : public boost::intrusive_ref_counter<BitExpr> {
+  friend class FrontendResultParser;
+
+private:
+  std::size_t id{0};
+
 public:
   enum Kind {
     Constant = 0,
@@ -83,6 +97,13 @@ public:
   }
 
   virtual Kind getKind() const = 0;
+  /**
+   * @brief Dense id given by the parser, in creation order, for tables
+   * indexed by expression.
+   */
+  std::size_t getId() const {
+    return id;
+  }
   virtual void print(std::ostream& os) const = 0;
   virtual bool equals(const BitExpr& rhs) const = 0;
   virtual std::size_t hash_value() const = 0;
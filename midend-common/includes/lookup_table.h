@@ -39,6 +39,21 @@ public:
   const DistributionTable& getDDT() const;
   const DistributionTable& getLAT() const;
 
+  /**
+   * @brief Nonzero entry of a DDT or LAT.
+   */
+  struct DistributionEntry {
+    std::uint32_t input;
+    std::uint32_t output;
+    int value;
+  };
+  using SparseDistribution = std::vector<DistributionEntry>;
+  /**
+   * @brief Nonzero entries of `getDDT()` and `getLAT()`, row by row.
+   */
+  const SparseDistribution& getSparseDDT() const;
+  const SparseDistribution& getSparseLAT() const;
+
   ~LookupTable();
 };
 
@@ -78,7 +78,7 @@ Ref<BitExpr> BitExpr::fromJSON(const FrontendResultParser& parser,
   if (type == "constant") {
     // Parse constant_expression
     auto value = j.at("value").get<int>();
-    return new ConstantBitExpr(value);
+    return parser.createExpr<ConstantBitExpr>(value != 0);
   } else if (type == "read") {
     // Parse read_expression
     auto target_name = j.at("target_name").get<std::string>();
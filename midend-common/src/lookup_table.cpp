@@ -19,6 +19,8 @@ public:
 
   std::optional<LookupTable::DistributionTable> ddt;
   std::optional<LookupTable::DistributionTable> lat;
+  std::optional<LookupTable::SparseDistribution> sparse_ddt;
+  std::optional<LookupTable::SparseDistribution> sparse_lat;
 
   LookupTableImpl(const std::string& name, std::uint64_t input_width,
                   std::uint64_t output_width,
@@ -100,6 +102,20 @@ public:
     //   std::println();
     // }
   }
+
+  static LookupTable::SparseDistribution sparsify(
+      const LookupTable::DistributionTable& table) {
+    LookupTable::SparseDistribution entries;
+    for (auto a = 0uz; a < table.size(); a++) {
+      for (auto b = 0uz; b < table[a].size(); b++) {
+        if (table[a][b] != 0) {
+          entries.push_back({static_cast<std::uint32_t>(a),
+                             static_cast<std::uint32_t>(b), table[a][b]});
+        }
+      }
+    }
+    return entries;
+  }
 };
 
 LookupTable::LookupTable(const std::string& name, std::uint64_t input_width,
@@ -143,6 +159,20 @@ const LookupTable::DistributionTable& LookupTable::getLAT() const {
   return *impl->lat;
 }
 
+const LookupTable::SparseDistribution& LookupTable::getSparseDDT() const {
+  if (!impl->sparse_ddt) {
+    impl->sparse_ddt = LookupTableImpl::sparsify(getDDT());
+  }
+  return *impl->sparse_ddt;
+}
+
+const LookupTable::SparseDistribution& LookupTable::getSparseLAT() const {
+  if (!impl->sparse_lat) {
+    impl->sparse_lat = LookupTableImpl::sparsify(getLAT());
+  }
+  return *impl->sparse_lat;
+}
+
 LookupTable::~LookupTable() = default;
 
 }  // namespace bonc
\ No newline at end of file
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <vector>
+
+namespace bonc::sat_modeller {
+
+/**
+ * @brief CSR-style clause storage.
+ *
+ * All literals live in one contiguous buffer of 32-bit DIMACS literals (signed
+ * variable index); `offsets[i]` and `offsets[i + 1]` delimit the i-th clause.
+ * Clauses are appended either as a whole (`add`) or literal by literal
+ * (`push` ... `commit`), the latter avoiding any temporary container.
+ */
+class ClauseArena {
+public:
+  using StoredLiteral = std::int32_t;
+  using ClauseView = std::span<const StoredLiteral>;
+
+  class Iterator {
+  private:
+    const ClauseArena* arena{nullptr};
+    std::size_t index{0};
+
+  public:
+    using iterator_concept = std::forward_iterator_tag;
+    using value_type = ClauseView;
+    using difference_type = std::ptrdiff_t;
+
+    Iterator() = default;
+    Iterator(const ClauseArena* arena, std::size_t index)
+        : arena{arena}, index{index} {}
+
+    ClauseView operator*() const {
+      return (*arena)[index];
+    }
+    Iterator& operator++() {
+      ++index;
+      return *this;
+    }
+    Iterator operator++(int) {
+      auto old = *this;
+      ++index;
+      return old;
+    }
+    friend bool operator==(const Iterator& lhs, const Iterator& rhs) = default;
+  };
+
+private:
+  std::vector<StoredLiteral> literals;
+  std::vector<std::size_t> offsets{0};
+
+public:
+  /**
+   * @brief Append one literal to the clause under construction.
+   */
+  void push(StoredLiteral lit) {
+    literals.push_back(lit);
+  }
+  /**
+   * @brief Close the clause under construction.
+   */
+  void commit() {
+    offsets.push_back(literals.size());
+  }
+  void add(ClauseView clause) {
+    literals.insert(literals.end(), clause.begin(), clause.end());
+    commit();
+  }
+
+  void reserve(std::size_t clause_count, std::size_t literal_count) {
+    offsets.reserve(clause_count + 1);
+    literals.reserve(literal_count);
+  }
+  void clear() {
+    literals.clear();
+    offsets.assign(1, 0);
+  }
+
+  std::size_t size() const {
+    return offsets.size() - 1;
+  }
+  std::size_t literalSize() const {
+    return literals.size();
+  }
+  std::size_t memoryUsage() const {
+    return literals.capacity() * sizeof(StoredLiteral)
+         + offsets.capacity() * sizeof(std::size_t);
+  }
+
+  ClauseView operator[](std::size_t index) const {
+    return ClauseView{literals}.subspan(offsets[index],
+                                        offsets[index + 1] - offsets[index]);
+  }
+  Iterator begin() const {
+    return Iterator{this, 0};
+  }
+  Iterator end() const {
+    return Iterator{this, size()};
+  }
+};
+
+static_assert(std::forward_iterator<ClauseArena::Iterator>);
+
+/**
+ * @brief Storage of XOR constraints `x_1 ^ x_2 ^ ... ^ x_n = rhs`, variables
+ * kept in a `ClauseArena`.
+ */
+class XorArena {
+public:
+  using StoredVariable = ClauseArena::StoredLiteral;
+  using VariablesView = ClauseArena::ClauseView;
+
+  struct XorView {
+    VariablesView variables;
+    bool rhs;
+  };
+
+private:
+  ClauseArena variables;
+  std::vector<bool> rhs;
+
+public:
+  void add(VariablesView vars, bool value) {
+    variables.add(vars);
+    rhs.push_back(value);
+  }
+  void clear() {
+    variables.clear();
+    rhs.clear();
+  }
+
+  std::size_t size() const {
+    return rhs.size();
+  }
+  std::size_t memoryUsage() const {
+    return variables.memoryUsage() + rhs.capacity() / 8;
+  }
+
+  XorView operator[](std::size_t index) const {
+    return XorView{variables[index], rhs[index]};
+  }
+};
+
+}  // namespace bonc::sat_modeller
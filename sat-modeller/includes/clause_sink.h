@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "clause_arena.h"
+
+namespace bonc::sat_modeller {
+
+/**
+ * @brief Receiver of the clauses produced by a `SATModel`.
+ *
+ * Clauses are handed over as soon as they are emitted, so a sink may forward
+ * them to a solver or a file without the model ever materialising its CNF.
+ */
+class ClauseSink {
+public:
+  using StoredLiteral = ClauseArena::StoredLiteral;
+  using ClauseView = ClauseArena::ClauseView;
+
+  virtual ~ClauseSink() = default;
+
+  virtual void addClause(ClauseView clause) = 0;
+  /**
+   * @brief Receive a native XOR constraint over variable indices.
+   *
+   * Sinks without XOR support fall back to the plain CNF expansion, which is
+   * exponential in the number of variables.
+   */
+  virtual void addXor(XorArena::VariablesView variables, bool rhs);
+  /**
+   * @brief Called once modelling is done.
+   *
+   * @param variable_count Number of variables, not counting the reserved
+   * index 0.
+   * @param clause_count Number of clauses and XOR constraints handed to this
+   * sink.
+   */
+  virtual void finish([[maybe_unused]] std::size_t variable_count,
+                      [[maybe_unused]] std::size_t clause_count) {}
+};
+
+/**
+ * @brief Keep all clauses in memory.
+ */
+class MemoryClauseSink : public ClauseSink {
+private:
+  ClauseArena arena;
+  XorArena xors;
+
+public:
+  void addClause(ClauseView clause) override {
+    arena.add(clause);
+  }
+  void addXor(XorArena::VariablesView variables, bool rhs) override {
+    xors.add(variables, rhs);
+  }
+  const ClauseArena& getClauses() const {
+    return arena;
+  }
+  const XorArena& getXors() const {
+    return xors;
+  }
+};
+
+/**
+ * @brief Write clauses to a DIMACS file through a large output buffer.
+ *
+ * Counts are unknown while streaming, so a fixed-width `p cnf` header is
+ * reserved first and patched in `finish`, with the clause count being the
+ * lines actually written.
+ */
+class DimacsFileSink : public ClauseSink {
+private:
+  std::FILE* file;
+  std::string buffer;
+  std::size_t written{0};
+
+  void flush();
+
+public:
+  explicit DimacsFileSink(const std::string& path);
+  DimacsFileSink(const DimacsFileSink&) = delete;
+  DimacsFileSink& operator=(const DimacsFileSink&) = delete;
+  ~DimacsFileSink() override;
+
+  void addClause(ClauseView clause) override;
+  /**
+   * @brief Written as an `x` line, the XOR extension of CryptoMiniSat's
+   * DIMACS dialect.
+   */
+  void addXor(XorArena::VariablesView variables, bool rhs) override;
+  void finish(std::size_t variable_count, std::size_t clause_count) override;
+};
+
+/**
+ * @brief Forward every clause to several sinks.
+ */
+class TeeClauseSink : public ClauseSink {
+private:
+  std::vector<ClauseSink*> sinks;
+
+public:
+  TeeClauseSink() = default;
+  TeeClauseSink(std::initializer_list<ClauseSink*> sinks) : sinks{sinks} {}
+
+  void add(ClauseSink& sink) {
+    sinks.push_back(&sink);
+  }
+  void remove(ClauseSink& sink) {
+    std::erase(sinks, &sink);
+  }
+  std::size_t size() const {
+    return sinks.size();
+  }
+
+  void addClause(ClauseView clause) override {
+    for (auto sink : sinks) {
+      sink->addClause(clause);
+    }
+  }
+  void addXor(XorArena::VariablesView variables, bool rhs) override {
+    for (auto sink : sinks) {
+      sink->addXor(variables, rhs);
+    }
+  }
+  void finish(std::size_t variable_count, std::size_t clause_count) override {
+    for (auto sink : sinks) {
+      sink->finish(variable_count, clause_count);
+    }
+  }
+};
+
+}  // namespace bonc::sat_modeller
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "clause_arena.h"
+
+namespace bonc::sat_modeller::dimacs {
+
+enum class Compression {
+  None,
+  Gzip,
+  Xz,
+};
+
+/**
+ * @brief Guess compression from the file suffix, `.gz` or `.xz`.
+ */
+Compression compressionFromPath(const std::string& path);
+
+/**
+ * @brief Write decimal text of a DIMACS literal at `out`, at most 11 chars.
+ *
+ * @return One past the last written char.
+ */
+char* formatLiteral(char* out, std::int32_t lit);
+
+/**
+ * @brief Format clauses `[first, last)` into `out`, each terminated by ` 0\n`.
+ */
+void formatClauses(std::string& out, const ClauseArena& clauses,
+                   std::size_t first, std::size_t last);
+
+/**
+ * @brief Format XOR constraints as `x` lines of CryptoMiniSat's DIMACS
+ * dialect.
+ *
+ * @return Lines written, which the header must count: an empty XOR with a
+ * false right-hand side holds and writes none
+ */
+std::size_t formatXors(std::string& out, const XorArena& xors);
+
+struct WriterOptions {
+  /**
+   * @brief Threads formatting disjoint clause ranges; chunks are still written
+   * in order so the output does not depend on this.
+   */
+  std::size_t threads{1};
+  Compression compression{Compression::None};
+};
+
+/**
+ * @brief Write a DIMACS CNF file, XOR constraints as `x` lines.
+ *
+ * @param variable_count Number of variables, not counting the reserved index
+ * 0.
+ */
+void write(const std::string& path, const ClauseArena& clauses,
+           const XorArena& xors, std::size_t variable_count,
+           const WriterOptions& options = {});
+
+struct ParsedCNF {
+  std::size_t variable_count{0};
+  ClauseArena clauses;
+  XorArena xors;
+};
+
+/**
+ * @brief Read a DIMACS CNF file, decompressing by the file suffix. `x` lines
+ * are read as XOR constraints.
+ */
+ParsedCNF read(const std::string& path);
+
+}  // namespace bonc::sat_modeller::dimacs
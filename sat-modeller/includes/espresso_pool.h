@@ -0,0 +1,99 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "table_template.h"
+
+namespace bonc::sat_modeller {
+
+/**
+ * @brief ON-set of a single-output function over `width <= 64` inputs, one
+ * minterm per true point, input `i` being bit `i`.
+ */
+struct EspressoCover {
+  std::size_t width{0};
+  std::vector<std::uint64_t> minterms;
+};
+
+/**
+ * @brief Minimise covers with espresso in forked worker processes.
+ *
+ * Espresso keeps its state in process globals, so one process can only run
+ * one minimisation at a time; every worker owns a private copy and they
+ * take queued covers in turn over a socket each. A worker dying, e.g. on an
+ * espresso `fatal`, fails its job instead of the caller, and is replaced by
+ * a new one for the following jobs. If the last one cannot be, the
+ * remaining jobs are minimised in this process.
+ *
+ * All workers are forked by a spawner process, itself forked by the
+ * constructor, which should run before the caller starts threads of its own.
+ */
+class EspressoPool {
+private:
+  struct Job {
+    EspressoCover cover;
+    std::promise<TableTemplate> promise;
+  };
+  struct Worker {
+    // -1 once it could not be replaced
+    int fd;
+  };
+
+  pid_t spawner{-1};
+  int spawner_fd{-1};
+  std::vector<Worker> workers;
+  std::mutex mutex;
+  std::condition_variable queued;
+  std::deque<Job> jobs;
+  // workers not given up on
+  std::size_t live{0};
+  bool stopping{false};
+  std::vector<std::jthread> dispatchers;
+
+  /**
+   * @brief Replace the exited process of `worker` by a new one.
+   *
+   * @return Whether its dispatcher should go on: with the new worker, or
+   * in this process if none could be started and it was the last one
+   */
+  bool respawn(Worker& worker);
+  /**
+   * @brief Close the sockets and wait for the spawner, which waits for the
+   * workers.
+   */
+  void stopWorkers();
+  void dispatch(Worker& worker);
+
+public:
+  /**
+   * @param workers Worker processes; with 0, `submit` minimises in this
+   * process right away.
+   */
+  explicit EspressoPool(std::size_t workers);
+  EspressoPool(const EspressoPool&) = delete;
+  EspressoPool& operator=(const EspressoPool&) = delete;
+  /**
+   * @brief Finish the queued jobs, then stop the workers.
+   */
+  ~EspressoPool();
+
+  std::size_t size() const {
+    return workers.size();
+  }
+
+  /**
+   * @brief Queue `cover` to be minimised into clauses the way
+   * `SATModel::buildTableTemplate` does.
+   */
+  std::future<TableTemplate> submit(EspressoCover cover);
+};
+
+}  // namespace bonc::sat_modeller
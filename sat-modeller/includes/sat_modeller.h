@@ -2,19 +2,39 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <format>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <functional>
+#include <initializer_list>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string_view>
 
+#include "clause_arena.h"
+#include "clause_sink.h"
+#include "espresso_pool.h"
 #include "table_template.h"
 
 namespace bonc::sat_modeller {
 
+/**
+ * @brief Name of a variable: an interned prefix, followed by the position
+ * within its `createVariables` batch if it has one. Only formatted when
+ * printed.
+ */
 struct VariableDetail {
-  std::string name;
+  static constexpr std::uint32_t NO_INDEX =
+      std::numeric_limits<std::uint32_t>::max();
+
+  std::uint32_t prefix{0};
+  std::uint32_t index{NO_INDEX};
 };
 
 class Literal;
@@ -88,31 +108,247 @@ namespace bonc::sat_modeller {
 
 using RawTable = std::vector<std::vector<int>>;
 
+class SATModel;
+
+enum class CardinalityEncoding {
+  /**
+   * @brief [Sinz 2005], (n-1)k auxiliary variables, not incremental.
+   */
+  SequentialCounter,
+  /**
+   * @brief [Bailleux & Boufkhad 2003], outputs truncated at k+1.
+   */
+  Totalizer,
+  /**
+   * @brief [Ogawa et al. 2013], unary quotient and remainder digits.
+   */
+  ModuloTotalizer,
+  /**
+   * @brief [Asín et al. 2011], odd-even simplified merging networks.
+   */
+  CardinalityNetwork,
+};
+
+struct WeightedVariable {
+  Variable var;
+  std::size_t weight;
+};
+
+std::optional<CardinalityEncoding> parseCardinalityEncoding(
+    std::string_view name);
+std::string_view cardinalityEncodingName(CardinalityEncoding encoding);
+
+/**
+ * @brief Handle to an encoded `sum(x) <= k`.
+ *
+ * Besides the asserted bound `k`, incremental encodings can be tightened to
+ * any `k' < k` by solving under the literals from `assumeAtMost`, so the same
+ * solver can be reused across bounds.
+ */
+class CardinalityBound {
+  friend class SATModel;
+
+private:
+  CardinalityEncoding encoding{CardinalityEncoding::SequentialCounter};
+  std::size_t bound{0};
+  // (value, var): var is implied whenever sum(x) >= value
+  std::vector<std::pair<std::size_t, Variable>> outputs;
+  // modulo totalizer digits, upper[i] / lower[i] implied by quotient /
+  // remainder >= i + 1
+  std::vector<Variable> upper;
+  std::vector<Variable> lower;
+  std::size_t modulo{0};
+  std::vector<std::pair<std::size_t, Variable>> comparators;
+  bool weighted{false};
+  std::size_t aux_variables{0};
+  std::size_t aux_clauses{0};
+
+public:
+  CardinalityEncoding getEncoding() const {
+    return encoding;
+  }
+  std::size_t getBound() const {
+    return bound;
+  }
+  bool incremental() const {
+    return encoding != CardinalityEncoding::SequentialCounter;
+  }
+  std::size_t auxVariables() const {
+    return aux_variables;
+  }
+  std::size_t auxClauses() const {
+    return aux_clauses;
+  }
+
+  /**
+   * @brief Literals to assume for `sum(x) <= k`, `k <= getBound()`.
+   *
+   * The modulo totalizer needs a guarded comparator clause, which is added to
+   * `model` the first time `k` is asked for.
+   */
+  std::vector<Literal> assumeAtMost(SATModel& model, std::size_t k);
+};
+
+enum class XorEncoding {
+  /**
+   * @brief Keep XOR constraints as such and hand them to the sink.
+   */
+  Native,
+  /**
+   * @brief Cut XOR constraints into bounded-width chunks linked by auxiliary
+   * variables, each one expanded into CNF.
+   */
+  Cnf,
+};
+
 class SATModel {
 public:
-  struct Clause {
-    std::vector<Literal> lits;
-  };
+  using ClauseView = ClauseArena::ClauseView;
+  static constexpr std::size_t DEFAULT_XOR_CUT_WIDTH = 5;
 
 private:
+  struct PrefixHash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view prefix) const {
+      return std::hash<std::string_view>{}(prefix);
+    }
+  };
+
   std::vector<VariableDetail> variables{{}};
-  std::vector<Clause> clauses;
+  std::vector<std::string> name_prefixes{""};
+  std::unordered_map<std::string, std::uint32_t, PrefixHash, std::equal_to<>>
+      prefix_ids{{"", 0}};
+  MemoryClauseSink memory;
+  ClauseSink* sink{&memory};
+  std::vector<ClauseArena::StoredLiteral> pending;
+  std::size_t clause_count{0};
+  std::size_t xor_count{0};
+
+  XorEncoding xor_encoding{XorEncoding::Cnf};
+  std::size_t xor_cut_width{DEFAULT_XOR_CUT_WIDTH};
+
+  void pushLiteral(Literal lit);
+  void commitClause();
+  void expandXor(std::span<const Variable> variables, bool rhs);
+  std::uint32_t internPrefix(std::string_view prefix);
+  static EspressoCover emptyTemplateCover(std::size_t input_width,
+                                          std::size_t output_width);
+  static std::uint64_t templateMinterm(std::size_t input_width,
+                                       std::size_t output_width,
+                                       std::uint64_t input,
+                                       std::uint64_t output,
+                                       std::size_t weight) {
+    auto weight_bits = ((std::uint64_t{1} << weight) - 1)
+                    << (output_width - weight);
+    return input | (output << input_width)
+         | (weight_bits << (input_width + output_width));
+  }
 
 public:
-  Variable createVariable(const std::string& name = "");
+  SATModel() = default;
+  /**
+   * @brief Stream clauses into `sink` instead of storing them in the model.
+   */
+  explicit SATModel(ClauseSink& sink) : sink{&sink} {}
+  SATModel(const SATModel&) = delete;
+  SATModel& operator=(const SATModel&) = delete;
+
+  /**
+   * @brief How XOR constraints are emitted.
+   *
+   * @param cut_width Max operands per CNF chunk for `XorEncoding::Cnf`, at
+   * least 3; 0 expands whole constraints.
+   */
+  void setXorEncoding(XorEncoding encoding,
+                      std::size_t cut_width = DEFAULT_XOR_CUT_WIDTH) {
+    assert(cut_width == 0 || cut_width >= 3);
+    xor_encoding = encoding;
+    xor_cut_width = cut_width;
+  }
+  XorEncoding getXorEncoding() const {
+    return xor_encoding;
+  }
+  std::size_t getXorCutWidth() const {
+    return xor_cut_width;
+  }
+
+  Variable createVariable(std::string_view name = "");
+  /**
+   * @brief `count` variables named `<name_prefix>_<i>`, sharing one stored
+   * prefix.
+   */
   std::vector<Variable> createVariables(std::size_t count,
-                                        const std::string& name_prefix = "");
-  void addClause(const std::vector<Literal>& lits);
+                                        std::string_view name_prefix = "");
+  /**
+   * @brief Create a variable named like variable `index` of `other`.
+   */
+  Variable copyVariable(const SATModel& other, std::size_t index);
+  void addClause(std::span<const Literal> lits);
+  void addClause(std::initializer_list<Literal> lits);
   using GetWeightFunction = std::move_only_function<std::size_t(int)>;
+  /**
+   * @brief ON-set minimised by `buildTableTemplate`: the input, output and
+   * weight bits of every possible transition, the weight in unary with its
+   * ones last.
+   */
+  static EspressoCover tableTemplateCover(const RawTable& table,
+                                          GetWeightFunction weight_fn);
+  /**
+   * @brief `tableTemplateCover` from the nonzero `entries` of a table only,
+   * each with `input`, `output` and `value` members.
+   */
+  template <class Entries>
+  static EspressoCover tableTemplateCover(std::size_t input_width,
+                                          std::size_t output_width,
+                                          const Entries& entries,
+                                          GetWeightFunction weight_fn) {
+    auto cover = emptyTemplateCover(input_width, output_width);
+    cover.minterms.reserve(std::ranges::size(entries));
+    for (auto& entry : entries) {
+      cover.minterms.push_back(
+          templateMinterm(input_width, output_width, entry.input,
+                          entry.output, weight_fn(entry.value)));
+    }
+    return cover;
+  }
   static TableTemplate buildTableTemplate(const RawTable& table, GetWeightFunction weight_fn);
+  static TableTemplate buildTableTemplate(const EspressoCover& cover);
   std::vector<Variable> addWeightTableClauses(
       const TableTemplate& table, const std::vector<Variable>& inputs,
       const std::vector<Variable>& outputs);
+  /**
+   * @brief `values[0] ^ values[1] ^ ... = result`
+   */
   void addXorClause(const std::vector<Variable>& values, Variable result);
+  /**
+   * @brief `variables[0] ^ variables[1] ^ ... = rhs`
+   */
+  void addXorConstraint(std::span<const Variable> variables, bool rhs);
   void addAndClause(const std::vector<Variable>& values, Variable result);
   void addOrClause(const std::vector<Variable>& values, Variable result);
   void addEquivalentClause(const std::vector<Variable>& values);
   void addSequentialCounterLessEqualClause(std::vector<Variable> x, int k);
+  /**
+   * @brief Sequential counter asserting `sum(x) <= k`, `k >= 1`, keeping a
+   * register row for every prefix of `x`.
+   *
+   * @return `result[i][j]` is implied by `sum(x[0..i]) >= j + 1`, so a
+   * negated register bounds a prefix.
+   */
+  std::vector<std::vector<Variable>> addSequentialCounter(
+      std::span<const Variable> x, std::size_t k);
+  /**
+   * @brief Assert `sum(x) <= k` with the given encoding.
+   */
+  CardinalityBound addCardinalityLessEqual(std::span<const Variable> x,
+                                           std::size_t k,
+                                           CardinalityEncoding encoding);
+  /**
+   * @brief Assert `sum(weight * x) <= k` with a generalized totalizer
+   * [Joshi et al. 2015], which is incremental like the totalizer.
+   */
+  CardinalityBound addWeightedLessEqual(std::span<const WeightedVariable> x,
+                                        std::size_t k);
   void printLiteral(std::ostream& os, Literal lit, bool print_name) const;
   void print(std::ostream& os, bool print_names = true) const;
   void printDIMACS(std::ostream& os);
@@ -123,8 +359,42 @@ public:
   const VariableDetail& getVariableDetail(std::size_t index) const {
     return variables.at(index);
   }
-  std::vector<Clause> getClauses() const {
-    return clauses;
+  std::string getVariableName(std::size_t index) const;
+  /**
+   * @brief Approximate bytes taken by variable names.
+   */
+  std::size_t nameMemoryUsage() const;
+  /**
+   * @brief Notify the sink that modelling is done, e.g. to patch the DIMACS
+   * header.
+   */
+  void finish() {
+    sink->finish(variables.size() - 1, clause_count + xor_count);
+  }
+  std::size_t clauseSize() const {
+    return clause_count;
+  }
+  /**
+   * @brief Number of native XOR constraints.
+   */
+  std::size_t xorSize() const {
+    return xor_count;
+  }
+  /**
+   * @brief Whether clauses are kept in memory, i.e. no external sink is set.
+   */
+  bool storesClauses() const {
+    return sink == &memory;
+  }
+  /**
+   * @brief Zero-copy access to stored clauses, each one is a span of DIMACS
+   * literals. Empty if clauses are streamed into an external sink.
+   */
+  const ClauseArena& getClauses() const {
+    return memory.getClauses();
+  }
+  const XorArena& getXors() const {
+    return memory.getXors();
   }
 };
 
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "clause_arena.h"
+
+namespace bonc::sat_modeller {
+
+/**
+ * @brief CNF after `simplify`, over compacted variables `1..variable_count`.
+ */
+struct SimplifiedCNF {
+  using StoredLiteral = ClauseArena::StoredLiteral;
+  /**
+   * @brief Image of a variable fixed to true; `-FIXED_TRUE` is fixed to false.
+   */
+  static constexpr StoredLiteral FIXED_TRUE =
+      std::numeric_limits<StoredLiteral>::max();
+
+  std::size_t variable_count{0};
+  ClauseArena clauses;
+  XorArena xors;
+  /**
+   * @brief `mapping[var]` is the image of original variable `var`: a literal
+   * over the simplified variables it equals, `+-FIXED_TRUE`, or 0 if it is
+   * left unconstrained.
+   */
+  std::vector<StoredLiteral> mapping;
+  /**
+   * @brief Whether a conflict was found; `clauses` is then a single empty
+   * clause.
+   */
+  bool unsatisfiable{false};
+
+  std::size_t fixedSize() const;
+  /**
+   * @brief Original variables replaced by an equivalent literal.
+   */
+  std::size_t equivalentSize() const;
+  /**
+   * @brief Original variables no longer constrained at all.
+   */
+  std::size_t freeSize() const;
+};
+
+/**
+ * @brief Preprocess a CNF: propagate units, substitute equivalent literals
+ * found as strongly connected components of the binary implication graph
+ * (and in 2-variable XORs), drop satisfied clauses and unused variables, and
+ * renumber the rest densely.
+ *
+ * XOR constraints are kept, with fixed and equivalent variables folded in.
+ *
+ * @param variable_count Number of variables, not counting the reserved index
+ * 0.
+ */
+SimplifiedCNF simplify(const ClauseArena& clauses, const XorArena& xors,
+                       std::size_t variable_count);
+
+}  // namespace bonc::sat_modeller
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+#include "sat_modeller.h"
+
+namespace bonc::sat_modeller {
+
+namespace {
+
+constexpr std::pair<CardinalityEncoding, std::string_view> ENCODING_NAMES[] = {
+    {CardinalityEncoding::SequentialCounter, "seqcounter"},
+    {CardinalityEncoding::Totalizer, "totalizer"},
+    {CardinalityEncoding::ModuloTotalizer, "mtotalizer"},
+    {CardinalityEncoding::CardinalityNetwork, "cardnetwork"},
+};
+
+// Every encoding below only contains the "upward" half of its clauses, i.e.
+// an output is implied by enough true inputs but not the other way round,
+// which is all a `<=` bound needs.
+
+/**
+ * Unary counter of `x`, `result[i]` implied by `sum(x) >= i + 1`, truncated
+ * to `cap` outputs.
+ */
+std::vector<Variable> totalize(SATModel& model, std::span<const Variable> x,
+                               std::size_t cap) {
+  if (x.size() == 1) {
+    return {x[0]};
+  }
+  auto a = totalize(model, x.first(x.size() / 2), cap);
+  auto b = totalize(model, x.subspan(x.size() / 2), cap);
+  auto r = model.createVariables(std::min(a.size() + b.size(), cap), "tot");
+  // sums beyond the last output are covered by a pair summing to it exactly
+  for (auto i = 0uz; i <= a.size(); i++) {
+    for (auto j = 0uz; j <= b.size() && i + j <= r.size(); j++) {
+      if (i == 0 && j == 0) {
+        continue;
+      }
+      auto out = r[i + j - 1];
+      if (i == 0) {
+        model.addClause({-b[j - 1], out});
+      } else if (j == 0) {
+        model.addClause({-a[i - 1], out});
+      } else {
+        model.addClause({-a[i - 1], -b[j - 1], out});
+      }
+    }
+  }
+  return r;
+}
+
+struct ModuloDigits {
+  std::vector<Variable> upper;
+  std::vector<Variable> lower;
+};
+
+/**
+ * `sum(x) = p * quotient + remainder`, both kept as unary digits, quotient
+ * truncated to `max_upper` digits.
+ */
+ModuloDigits moduloTotalize(SATModel& model, std::span<const Variable> x,
+                            std::size_t p, std::size_t max_upper) {
+  if (x.size() == 1) {
+    return {{}, {x[0]}};
+  }
+  auto a = moduloTotalize(model, x.first(x.size() / 2), p, max_upper);
+  auto b = moduloTotalize(model, x.subspan(x.size() / 2), p, max_upper);
+  auto has_carry = a.lower.size() + b.lower.size() >= p;
+  ModuloDigits r;
+  r.lower = model.createVariables(
+      std::min(p - 1, a.lower.size() + b.lower.size()), "mtot_l");
+  r.upper = model.createVariables(
+      std::min(max_upper, a.upper.size() + b.upper.size() + has_carry),
+      "mtot_u");
+  std::optional<Variable> carry;
+  if (has_carry) {
+    carry = model.createVariable("mtot_c");
+  }
+
+  // digit 0 of a unary number is constant true, and dropped from clauses
+  std::vector<Literal> clause;
+  auto add = [&](const std::vector<Variable>& lhs, std::size_t i,
+                 const std::vector<Variable>& rhs, std::size_t j,
+                 std::initializer_list<Literal> tail) {
+    clause.clear();
+    if (i > 0) {
+      clause.push_back(-lhs[i - 1]);
+    }
+    if (j > 0) {
+      clause.push_back(-rhs[j - 1]);
+    }
+    clause.insert(clause.end(), tail);
+    model.addClause(clause);
+  };
+  for (auto i = 0uz; i <= a.lower.size(); i++) {
+    for (auto j = 0uz; j <= b.lower.size(); j++) {
+      auto sum = i + j;
+      if (sum == 0) {
+        continue;
+      }
+      if (sum < p) {
+        // a set carry already accounts for this remainder
+        if (carry) {
+          add(a.lower, i, b.lower, j, {*carry, r.lower[sum - 1]});
+        } else {
+          add(a.lower, i, b.lower, j, {r.lower[sum - 1]});
+        }
+      } else {
+        add(a.lower, i, b.lower, j, {*carry});
+        if (sum > p) {
+          add(a.lower, i, b.lower, j, {r.lower[sum - p - 1]});
+        }
+      }
+    }
+  }
+  for (auto i = 0uz; i <= a.upper.size(); i++) {
+    for (auto j = 0uz; j <= b.upper.size(); j++) {
+      auto sum = i + j;
+      if (sum >= 1 && sum <= r.upper.size()) {
+        add(a.upper, i, b.upper, j, {r.upper[sum - 1]});
+      }
+      if (carry && sum + 1 <= r.upper.size()) {
+        add(a.upper, i, b.upper, j, {-*carry, r.upper[sum]});
+      }
+    }
+  }
+  return r;
+}
+
+/**
+ * Building blocks of [Asín et al. 2011], every comparator sorts two bits in
+ * descending order.
+ */
+class CardinalityNetworkBuilder {
+private:
+  SATModel& model;
+
+  std::pair<Variable, Variable> comparator(Variable a, Variable b) {
+    auto high = model.createVariable("card_net");
+    auto low = model.createVariable("card_net");
+    model.addClause({-a, high});
+    model.addClause({-b, high});
+    model.addClause({-a, -b, low});
+    return {high, low};
+  }
+
+  static std::vector<Variable> stride(std::span<const Variable> x,
+                                      std::size_t start) {
+    std::vector<Variable> result;
+    for (auto i = start; i < x.size(); i += 2) {
+      result.push_back(x[i]);
+    }
+    return result;
+  }
+
+  /**
+   * Merge two sorted sequences of the same power of two length, keeping
+   * `a.size() + 1` outputs if `simplified`, all of them otherwise.
+   */
+  std::vector<Variable> merge(std::span<const Variable> a,
+                              std::span<const Variable> b, bool simplified) {
+    auto n = a.size();
+    if (n == 1) {
+      auto [high, low] = comparator(a[0], b[0]);
+      return {high, low};
+    }
+    auto d = merge(stride(a, 0), stride(b, 0), simplified);
+    auto e = merge(stride(a, 1), stride(b, 1), simplified);
+    std::vector<Variable> c{d[0]};
+    auto pairs = simplified ? n / 2 : n - 1;
+    for (auto i = 1uz; i <= pairs; i++) {
+      auto [high, low] = comparator(d[i], e[i - 1]);
+      c.push_back(high);
+      c.push_back(low);
+    }
+    if (!simplified) {
+      c.push_back(e[n - 1]);
+    }
+    return c;
+  }
+
+  std::vector<Variable> sort(std::span<const Variable> x) {
+    if (x.size() == 1) {
+      return {x[0]};
+    }
+    auto half = x.size() / 2;
+    auto d = sort(x.first(half));
+    auto e = sort(x.subspan(half));
+    return merge(d, e, false);
+  }
+
+public:
+  explicit CardinalityNetworkBuilder(SATModel& model) : model{model} {}
+
+  /**
+   * The `m` largest bits of `x` in descending order, `x.size()` is a
+   * multiple of `m`, which is a power of two.
+   */
+  std::vector<Variable> network(std::span<const Variable> x, std::size_t m) {
+    if (x.size() == m) {
+      return sort(x);
+    }
+    auto d = network(x.first(m), m);
+    auto e = network(x.subspan(m), m);
+    auto c = merge(d, e, true);
+    c.pop_back();
+    return c;
+  }
+};
+
+using WeightedOutputs = std::map<std::size_t, Variable>;
+
+/**
+ * Generalized totalizer: one output per reachable sum, sums capped at `cap`.
+ */
+WeightedOutputs generalizedTotalize(SATModel& model,
+                                    std::span<const WeightedVariable> x,
+                                    std::size_t cap) {
+  if (x.size() == 1) {
+    return {{std::min(x[0].weight, cap), x[0].var}};
+  }
+  auto a = generalizedTotalize(model, x.first(x.size() / 2), cap);
+  auto b = generalizedTotalize(model, x.subspan(x.size() / 2), cap);
+  WeightedOutputs r;
+  auto output = [&](std::size_t value) {
+    value = std::min(value, cap);
+    if (auto it = r.find(value); it != r.end()) {
+      return it->second;
+    }
+    return r.emplace(value, model.createVariable("gtot")).first->second;
+  };
+  for (auto [value, var] : a) {
+    model.addClause({-var, output(value)});
+  }
+  for (auto [value, var] : b) {
+    model.addClause({-var, output(value)});
+  }
+  for (auto [value_a, var_a] : a) {
+    for (auto [value_b, var_b] : b) {
+      model.addClause({-var_a, -var_b, output(value_a + value_b)});
+    }
+  }
+  return r;
+}
+
+}  // namespace
+
+std::optional<CardinalityEncoding> parseCardinalityEncoding(
+    std::string_view name) {
+  for (auto [encoding, encoding_name] : ENCODING_NAMES) {
+    if (encoding_name == name) {
+      return encoding;
+    }
+  }
+  return std::nullopt;
+}
+
+std::string_view cardinalityEncodingName(CardinalityEncoding encoding) {
+  for (auto [value, name] : ENCODING_NAMES) {
+    if (value == encoding) {
+      return name;
+    }
+  }
+  throw std::invalid_argument("Unknown cardinality encoding");
+}
+
+std::vector<Literal> CardinalityBound::assumeAtMost(SATModel& model,
+                                                    std::size_t k) {
+  if (k > bound) {
+    throw std::invalid_argument(
+        std::format("Cannot relax cardinality bound {} to {}", bound, k));
+  }
+  std::vector<Literal> assumptions;
+  if (k == bound) {
+    return assumptions;
+  }
+  switch (encoding) {
+    case CardinalityEncoding::SequentialCounter:
+      throw std::logic_error("Sequential counter is not incremental");
+    case CardinalityEncoding::Totalizer:
+    case CardinalityEncoding::CardinalityNetwork:
+      // sums above `k` imply the first output above `k` as well, except for
+      // weighted outputs, which are not unary
+      for (auto [value, var] : outputs) {
+        if (value > k) {
+          assumptions.push_back(-var);
+          if (!weighted) {
+            break;
+          }
+        }
+      }
+      break;
+    case CardinalityEncoding::ModuloTotalizer: {
+      auto q = k / modulo;
+      auto r = k % modulo;
+      if (q < upper.size()) {
+        assumptions.push_back(-upper[q]);
+      }
+      if (r >= lower.size()) {
+        break;
+      }
+      if (q == 0) {
+        assumptions.push_back(-lower[r]);
+      } else if (q <= upper.size()) {
+        // quotient == q and remainder > r, guarded by a selector
+        auto it = std::ranges::find(comparators, k,
+                                    &std::pair<std::size_t, Variable>::first);
+        if (it == comparators.end()) {
+          auto selector = model.createVariable(std::format("mtot_le_{}", k));
+          model.addClause({-selector, -upper[q - 1], -lower[r]});
+          it = comparators.emplace(comparators.end(), k, selector);
+        }
+        assumptions.push_back(it->second);
+      }
+      break;
+    }
+  }
+  return assumptions;
+}
+
+CardinalityBound SATModel::addCardinalityLessEqual(
+    std::span<const Variable> x, std::size_t k, CardinalityEncoding encoding) {
+  auto first_variable = variables.size();
+  auto first_clause = clause_count;
+  CardinalityBound result;
+  result.encoding = encoding;
+  result.bound = k;
+  auto n = x.size();
+
+  if (k == 0) {
+    for (auto var : x) {
+      addClause({-var});
+    }
+  } else if (n == 0
+             || (k >= n
+                 && encoding == CardinalityEncoding::SequentialCounter)) {
+    // always satisfied
+  } else {
+    switch (encoding) {
+      case CardinalityEncoding::SequentialCounter:
+        addSequentialCounterLessEqualClause(std::vector(x.begin(), x.end()),
+                                            int(k));
+        break;
+      case CardinalityEncoding::Totalizer: {
+        auto r = totalize(*this, x, std::min(n, k + 1));
+        for (auto i = 0uz; i < r.size(); i++) {
+          result.outputs.emplace_back(i + 1, r[i]);
+        }
+        if (k < r.size()) {
+          addClause({-r[k]});
+        }
+        break;
+      }
+      case CardinalityEncoding::ModuloTotalizer: {
+        auto p = std::max(2uz, std::size_t(std::sqrt(double(k + 1))));
+        auto [upper, lower] = moduloTotalize(*this, x, p, k / p + 1);
+        result.upper = std::move(upper);
+        result.lower = std::move(lower);
+        result.modulo = p;
+        auto q = k / p;
+        auto r = k % p;
+        if (q < result.upper.size()) {
+          addClause({-result.upper[q]});
+        }
+        if (r < result.lower.size()) {
+          if (q == 0) {
+            addClause({-result.lower[r]});
+          } else if (q <= result.upper.size()) {
+            addClause({-result.upper[q - 1], -result.lower[r]});
+          }
+        }
+        break;
+      }
+      case CardinalityEncoding::CardinalityNetwork: {
+        auto m = std::bit_ceil(std::min(n, k) + 1);
+        std::vector<Variable> padded(x.begin(), x.end());
+        if (padded.size() % m != 0) {
+          auto zero = createVariable("card_zero");
+          addClause({-zero});
+          padded.resize((padded.size() / m + 1) * m, zero);
+        }
+        auto c = CardinalityNetworkBuilder{*this}.network(padded, m);
+        for (auto i = 0uz; i < c.size(); i++) {
+          result.outputs.emplace_back(i + 1, c[i]);
+        }
+        if (k < c.size()) {
+          addClause({-c[k]});
+        }
+        break;
+      }
+    }
+  }
+
+  result.aux_variables = variables.size() - first_variable;
+  result.aux_clauses = clause_count - first_clause;
+  return result;
+}
+
+CardinalityBound SATModel::addWeightedLessEqual(
+    std::span<const WeightedVariable> x, std::size_t k) {
+  auto first_variable = variables.size();
+  auto first_clause = clause_count;
+  CardinalityBound result;
+  result.encoding = CardinalityEncoding::Totalizer;
+  result.weighted = true;
+  result.bound = k;
+
+  std::vector<WeightedVariable> operands;
+  for (auto operand : x) {
+    if (operand.weight == 0) {
+      continue;
+    }
+    if (operand.weight > k) {
+      addClause({-operand.var});
+      continue;
+    }
+    operands.push_back(operand);
+  }
+  if (!operands.empty()) {
+    for (auto [value, var] : generalizedTotalize(*this, operands, k + 1)) {
+      result.outputs.emplace_back(value, var);
+      if (value > k) {
+        addClause({-var});
+      }
+    }
+  }
+
+  result.aux_variables = variables.size() - first_variable;
+  result.aux_clauses = clause_count - first_clause;
+  return result;
+}
+
+}  // namespace bonc::sat_modeller
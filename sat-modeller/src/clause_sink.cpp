@@ -0,0 +1,115 @@
+#include "clause_sink.h"
+
+#include <bit>
+#include <cassert>
+#include <format>
+#include <limits>
+#include <stdexcept>
+
+#include "dimacs.h"
+
+namespace bonc::sat_modeller {
+
+namespace {
+
+constexpr auto BUFFER_SIZE = 1uz << 20;
+// "p cnf " followed by two left-aligned, space padded counts
+constexpr auto HEADER_COUNT_WIDTH = 20;
+
+std::string dimacsHeader(std::size_t variable_count,
+                         std::size_t clause_count) {
+  return std::format("p cnf {:<{}} {:<{}}\n", variable_count,
+                     HEADER_COUNT_WIDTH, clause_count, HEADER_COUNT_WIDTH);
+}
+
+}  // namespace
+
+void ClauseSink::addXor(XorArena::VariablesView variables, bool rhs) {
+  // forbid every assignment whose parity differs from rhs
+  assert(variables.size() < std::numeric_limits<std::size_t>::digits);
+  std::vector<StoredLiteral> clause(variables.size());
+  for (auto mask = 0uz; mask < (1uz << variables.size()); mask++) {
+    if (std::popcount(mask) % 2 == rhs) {
+      continue;
+    }
+    for (auto i = 0uz; i < variables.size(); i++) {
+      clause[i] = (mask >> i) & 1 ? -variables[i] : variables[i];
+    }
+    addClause(clause);
+  }
+}
+
+DimacsFileSink::DimacsFileSink(const std::string& path)
+    : file{std::fopen(path.c_str(), "wb")} {
+  if (!file) {
+    throw std::runtime_error(std::format("Failed to open {} for writing", path));
+  }
+  buffer.reserve(BUFFER_SIZE);
+  buffer += dimacsHeader(0, 0);
+}
+
+DimacsFileSink::~DimacsFileSink() {
+  if (file) {
+    std::fwrite(buffer.data(), 1, buffer.size(), file);
+    std::fclose(file);
+  }
+}
+
+void DimacsFileSink::flush() {
+  if (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+    throw std::runtime_error("Failed to write DIMACS output");
+  }
+  buffer.clear();
+}
+
+void DimacsFileSink::addClause(ClauseView clause) {
+  char text[16];
+  for (auto lit : clause) {
+    auto end = dimacs::formatLiteral(text, lit);
+    *end++ = ' ';
+    buffer.append(text, end);
+  }
+  buffer += "0\n";
+  written++;
+  if (buffer.size() >= BUFFER_SIZE) {
+    flush();
+  }
+}
+
+void DimacsFileSink::addXor(XorArena::VariablesView variables, bool rhs) {
+  if (variables.empty()) {
+    // `0 = 1` is the empty clause, `0 = 0` holds and writes nothing
+    if (rhs) {
+      buffer += "0\n";
+      written++;
+    }
+    return;
+  }
+  char text[16];
+  buffer += 'x';
+  for (auto i = 0uz; i < variables.size(); i++) {
+    // a negated literal flips the parity, the line itself means "= 1"
+    auto end = dimacs::formatLiteral(
+        text, i == 0 && !rhs ? -variables[i] : variables[i]);
+    *end++ = ' ';
+    buffer.append(text, end);
+  }
+  buffer += "0\n";
+  written++;
+  if (buffer.size() >= BUFFER_SIZE) {
+    flush();
+  }
+}
+
+void DimacsFileSink::finish(std::size_t variable_count, std::size_t) {
+  flush();
+  auto header = dimacsHeader(variable_count, written);
+  if (std::fseek(file, 0, SEEK_SET) != 0
+      || std::fwrite(header.data(), 1, header.size(), file) != header.size()
+      || std::fseek(file, 0, SEEK_END) != 0) {
+    throw std::runtime_error("Failed to patch DIMACS header");
+  }
+  std::fflush(file);
+}
+
+}  // namespace bonc::sat_modeller
@@ -0,0 +1,551 @@
+#include "dimacs.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_LIBLZMA
+#include <lzma.h>
+#endif
+
+namespace bonc::sat_modeller::dimacs {
+
+namespace {
+
+constexpr auto IO_BUFFER_SIZE = 1uz << 20;
+constexpr auto CLAUSES_PER_CHUNK = 1uz << 18;
+// '-' and 10 digits, plus the separating space
+constexpr auto MAX_LITERAL_TEXT = 12uz;
+
+constexpr auto DIGIT_PAIRS = [] {
+  std::array<char, 200> pairs{};
+  for (auto i = 0uz; i < 100; i++) {
+    pairs[2 * i] = static_cast<char>('0' + i / 10);
+    pairs[2 * i + 1] = static_cast<char>('0' + i % 10);
+  }
+  return pairs;
+}();
+
+class OutputFile {
+public:
+  virtual ~OutputFile() = default;
+  virtual void write(std::string_view data) = 0;
+  virtual void close() = 0;
+};
+
+class PlainOutputFile : public OutputFile {
+  std::FILE* file;
+
+public:
+  explicit PlainOutputFile(const std::string& path)
+      : file{std::fopen(path.c_str(), "wb")} {
+    if (!file) {
+      throw std::runtime_error(
+          std::format("Failed to open {} for writing", path));
+    }
+    std::setvbuf(file, nullptr, _IOFBF, IO_BUFFER_SIZE);
+  }
+  ~PlainOutputFile() override {
+    if (file) {
+      std::fclose(file);
+    }
+  }
+  void write(std::string_view data) override {
+    if (std::fwrite(data.data(), 1, data.size(), file) != data.size()) {
+      throw std::runtime_error("Failed to write DIMACS output");
+    }
+  }
+  void close() override {
+    auto ret = std::fclose(file);
+    file = nullptr;
+    if (ret != 0) {
+      throw std::runtime_error("Failed to close DIMACS output");
+    }
+  }
+};
+
+#ifdef USE_ZLIB
+class GzipOutputFile : public OutputFile {
+  gzFile file;
+
+public:
+  explicit GzipOutputFile(const std::string& path)
+      : file{gzopen(path.c_str(), "wb6")} {
+    if (!file) {
+      throw std::runtime_error(
+          std::format("Failed to open {} for writing", path));
+    }
+    gzbuffer(file, IO_BUFFER_SIZE);
+  }
+  ~GzipOutputFile() override {
+    if (file) {
+      gzclose(file);
+    }
+  }
+  void write(std::string_view data) override {
+    while (!data.empty()) {
+      auto size = static_cast<unsigned>(
+          std::min<std::size_t>(data.size(), std::numeric_limits<int>::max()));
+      if (gzwrite(file, data.data(), size) != static_cast<int>(size)) {
+        throw std::runtime_error("Failed to write gzip DIMACS output");
+      }
+      data.remove_prefix(size);
+    }
+  }
+  void close() override {
+    auto ret = gzclose(file);
+    file = nullptr;
+    if (ret != Z_OK) {
+      throw std::runtime_error("Failed to close gzip DIMACS output");
+    }
+  }
+};
+#endif
+
+#ifdef USE_LIBLZMA
+class XzOutputFile : public OutputFile {
+  PlainOutputFile file;
+  lzma_stream stream = LZMA_STREAM_INIT;
+  std::vector<std::uint8_t> buffer;
+
+  void run(lzma_action action) {
+    while (true) {
+      stream.next_out = buffer.data();
+      stream.avail_out = buffer.size();
+      auto ret = lzma_code(&stream, action);
+      if (ret != LZMA_OK && ret != LZMA_STREAM_END) {
+        throw std::runtime_error("Failed to compress xz DIMACS output");
+      }
+      file.write({reinterpret_cast<const char*>(buffer.data()),
+                  buffer.size() - stream.avail_out});
+      if (action == LZMA_RUN ? stream.avail_in == 0 : ret == LZMA_STREAM_END) {
+        return;
+      }
+    }
+  }
+
+public:
+  explicit XzOutputFile(const std::string& path)
+      : file{path}, buffer(IO_BUFFER_SIZE) {
+    if (lzma_easy_encoder(&stream, 6, LZMA_CHECK_CRC64) != LZMA_OK) {
+      throw std::runtime_error("Failed to initialize xz encoder");
+    }
+  }
+  ~XzOutputFile() override {
+    lzma_end(&stream);
+  }
+  void write(std::string_view data) override {
+    stream.next_in = reinterpret_cast<const std::uint8_t*>(data.data());
+    stream.avail_in = data.size();
+    run(LZMA_RUN);
+  }
+  void close() override {
+    run(LZMA_FINISH);
+    file.close();
+  }
+};
+#endif
+
+std::unique_ptr<OutputFile> openOutput(const std::string& path,
+                                       Compression compression) {
+  switch (compression) {
+    case Compression::None: return std::make_unique<PlainOutputFile>(path);
+#ifdef USE_ZLIB
+    case Compression::Gzip: return std::make_unique<GzipOutputFile>(path);
+#endif
+#ifdef USE_LIBLZMA
+    case Compression::Xz: return std::make_unique<XzOutputFile>(path);
+#endif
+    default:
+      throw std::runtime_error(
+          std::format("Compression for {} is not enabled in this build", path));
+  }
+}
+
+class InputFile {
+public:
+  virtual ~InputFile() = default;
+  /**
+   * @brief Read up to `size` bytes, returns 0 at end of file.
+   */
+  virtual std::size_t read(char* data, std::size_t size) = 0;
+};
+
+class PlainInputFile : public InputFile {
+  std::FILE* file;
+
+public:
+  explicit PlainInputFile(const std::string& path)
+      : file{std::fopen(path.c_str(), "rb")} {
+    if (!file) {
+      throw std::runtime_error(
+          std::format("Failed to open {} for reading", path));
+    }
+  }
+  ~PlainInputFile() override {
+    std::fclose(file);
+  }
+  std::size_t read(char* data, std::size_t size) override {
+    auto count = std::fread(data, 1, size, file);
+    if (count == 0 && std::ferror(file)) {
+      throw std::runtime_error("Failed to read DIMACS input");
+    }
+    return count;
+  }
+};
+
+#ifdef USE_ZLIB
+class GzipInputFile : public InputFile {
+  gzFile file;
+
+public:
+  explicit GzipInputFile(const std::string& path)
+      : file{gzopen(path.c_str(), "rb")} {
+    if (!file) {
+      throw std::runtime_error(
+          std::format("Failed to open {} for reading", path));
+    }
+    gzbuffer(file, IO_BUFFER_SIZE);
+  }
+  ~GzipInputFile() override {
+    gzclose(file);
+  }
+  std::size_t read(char* data, std::size_t size) override {
+    auto count = gzread(file, data,
+                        static_cast<unsigned>(std::min<std::size_t>(
+                            size, std::numeric_limits<int>::max())));
+    if (count < 0) {
+      throw std::runtime_error("Failed to read gzip DIMACS input");
+    }
+    return static_cast<std::size_t>(count);
+  }
+};
+#endif
+
+#ifdef USE_LIBLZMA
+class XzInputFile : public InputFile {
+  PlainInputFile file;
+  lzma_stream stream = LZMA_STREAM_INIT;
+  std::vector<std::uint8_t> buffer;
+  bool input_end{false};
+  bool stream_end{false};
+
+public:
+  explicit XzInputFile(const std::string& path)
+      : file{path}, buffer(IO_BUFFER_SIZE) {
+    if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED)
+        != LZMA_OK) {
+      throw std::runtime_error("Failed to initialize xz decoder");
+    }
+  }
+  ~XzInputFile() override {
+    lzma_end(&stream);
+  }
+  std::size_t read(char* data, std::size_t size) override {
+    stream.next_out = reinterpret_cast<std::uint8_t*>(data);
+    stream.avail_out = size;
+    while (!stream_end && stream.avail_out == size) {
+      if (stream.avail_in == 0 && !input_end) {
+        stream.next_in = buffer.data();
+        stream.avail_in = file.read(reinterpret_cast<char*>(buffer.data()),
+                                    buffer.size());
+        input_end = stream.avail_in == 0;
+      }
+      auto ret = lzma_code(&stream, input_end ? LZMA_FINISH : LZMA_RUN);
+      if (ret == LZMA_STREAM_END) {
+        stream_end = true;
+      } else if (ret != LZMA_OK) {
+        throw std::runtime_error("Failed to decompress xz DIMACS input");
+      }
+    }
+    return size - stream.avail_out;
+  }
+};
+#endif
+
+std::unique_ptr<InputFile> openInput(const std::string& path) {
+  switch (compressionFromPath(path)) {
+    case Compression::None: return std::make_unique<PlainInputFile>(path);
+#ifdef USE_ZLIB
+    case Compression::Gzip: return std::make_unique<GzipInputFile>(path);
+#endif
+#ifdef USE_LIBLZMA
+    case Compression::Xz: return std::make_unique<XzInputFile>(path);
+#endif
+    default:
+      throw std::runtime_error(
+          std::format("Compression for {} is not enabled in this build", path));
+  }
+}
+
+class Scanner {
+  InputFile& input;
+  std::vector<char> buffer;
+  std::size_t pos{0};
+  std::size_t end{0};
+
+public:
+  explicit Scanner(InputFile& input) : input{input}, buffer(IO_BUFFER_SIZE) {}
+
+  int peek() {
+    if (pos == end) {
+      pos = 0;
+      end = input.read(buffer.data(), buffer.size());
+      if (end == 0) {
+        return EOF;
+      }
+    }
+    return static_cast<unsigned char>(buffer[pos]);
+  }
+  int get() {
+    auto ch = peek();
+    if (ch != EOF) {
+      pos++;
+    }
+    return ch;
+  }
+  void skipSpaces() {
+    for (auto ch = peek(); ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+         ch = peek()) {
+      pos++;
+    }
+  }
+  void skipLine() {
+    for (auto ch = get(); ch != EOF && ch != '\n'; ch = get()) {
+    }
+  }
+  std::string readWord() {
+    skipSpaces();
+    std::string word;
+    for (auto ch = peek(); ch != EOF && !std::isspace(ch); ch = peek()) {
+      word += static_cast<char>(ch);
+      pos++;
+    }
+    return word;
+  }
+  std::int64_t readInt() {
+    skipSpaces();
+    bool negative = peek() == '-';
+    if (negative) {
+      pos++;
+    }
+    std::int64_t value = 0;
+    auto digits = 0uz;
+    for (auto ch = peek(); ch >= '0' && ch <= '9'; ch = peek()) {
+      value = value * 10 + (ch - '0');
+      if (value > std::numeric_limits<std::int32_t>::max()) {
+        throw std::runtime_error("DIMACS integer out of range");
+      }
+      pos++;
+      digits++;
+    }
+    if (digits == 0) {
+      throw std::runtime_error("Malformed DIMACS input, integer expected");
+    }
+    return negative ? -value : value;
+  }
+};
+
+}  // namespace
+
+Compression compressionFromPath(const std::string& path) {
+  if (path.ends_with(".gz")) {
+    return Compression::Gzip;
+  }
+  if (path.ends_with(".xz")) {
+    return Compression::Xz;
+  }
+  return Compression::None;
+}
+
+char* formatLiteral(char* out, std::int32_t lit) {
+  std::uint32_t value;
+  if (lit < 0) {
+    *out++ = '-';
+    value = static_cast<std::uint32_t>(-static_cast<std::int64_t>(lit));
+  } else {
+    value = static_cast<std::uint32_t>(lit);
+  }
+  char digits[10];
+  auto begin = std::end(digits);
+  while (value >= 100) {
+    auto pair = value % 100;
+    value /= 100;
+    begin -= 2;
+    std::memcpy(begin, &DIGIT_PAIRS[2 * pair], 2);
+  }
+  if (value >= 10) {
+    begin -= 2;
+    std::memcpy(begin, &DIGIT_PAIRS[2 * value], 2);
+  } else {
+    *--begin = static_cast<char>('0' + value);
+  }
+  auto length = std::end(digits) - begin;
+  std::memcpy(out, begin, length);
+  return out + length;
+}
+
+void formatClauses(std::string& out, const ClauseArena& clauses,
+                   std::size_t first, std::size_t last) {
+  auto capacity = 0uz;
+  for (auto i = first; i < last; i++) {
+    capacity += clauses[i].size() * MAX_LITERAL_TEXT + 2;
+  }
+  auto old_size = out.size();
+  out.resize_and_overwrite(
+      old_size + capacity, [&](char* data, std::size_t) -> std::size_t {
+        auto cursor = data + old_size;
+        for (auto i = first; i < last; i++) {
+          for (auto lit : clauses[i]) {
+            cursor = formatLiteral(cursor, lit);
+            *cursor++ = ' ';
+          }
+          *cursor++ = '0';
+          *cursor++ = '\n';
+        }
+        return cursor - data;
+      });
+}
+
+std::size_t formatXors(std::string& out, const XorArena& xors) {
+  char text[16];
+  auto lines = 0uz;
+  for (auto i = 0uz; i < xors.size(); i++) {
+    auto [variables, rhs] = xors[i];
+    if (variables.empty()) {
+      if (rhs) {
+        out += "0\n";
+        lines++;
+      }
+      continue;
+    }
+    out += 'x';
+    for (auto j = 0uz; j < variables.size(); j++) {
+      // the line means "= 1", a negated literal flips the parity
+      auto end = formatLiteral(
+          text, j == 0 && !rhs ? -variables[j] : variables[j]);
+      *end++ = ' ';
+      out.append(text, end);
+    }
+    out += "0\n";
+    lines++;
+  }
+  return lines;
+}
+
+void write(const std::string& path, const ClauseArena& clauses,
+           const XorArena& xors, std::size_t variable_count,
+           const WriterOptions& options) {
+  // formatted first, as they decide the clause count of the header
+  std::string xor_lines;
+  auto xor_count = formatXors(xor_lines, xors);
+  auto output = openOutput(path, options.compression);
+  output->write(std::format("p cnf {} {}\n", variable_count,
+                            clauses.size() + xor_count));
+
+  auto threads = std::max(options.threads, 1uz);
+  std::vector<std::string> chunks(threads);
+  for (auto first = 0uz; first < clauses.size();
+       first += threads * CLAUSES_PER_CHUNK) {
+    auto chunkRange = [&](std::size_t index) {
+      auto begin = std::min(first + index * CLAUSES_PER_CHUNK, clauses.size());
+      auto end = std::min(begin + CLAUSES_PER_CHUNK, clauses.size());
+      return std::pair{begin, end};
+    };
+    if (threads == 1) {
+      auto [begin, end] = chunkRange(0);
+      chunks[0].clear();
+      formatClauses(chunks[0], clauses, begin, end);
+    } else {
+      std::vector<std::jthread> workers;
+      for (auto i = 0uz; i < threads; i++) {
+        workers.emplace_back([&, i] {
+          auto [begin, end] = chunkRange(i);
+          chunks[i].clear();
+          formatClauses(chunks[i], clauses, begin, end);
+        });
+      }
+    }
+    for (const auto& chunk : chunks) {
+      output->write(chunk);
+    }
+  }
+  output->write(xor_lines);
+  output->close();
+}
+
+ParsedCNF read(const std::string& path) {
+  auto input = openInput(path);
+  Scanner scanner{*input};
+  ParsedCNF result;
+  std::int64_t max_variable = 0;
+  std::vector<XorArena::StoredVariable> xor_variables;
+  while (true) {
+    scanner.skipSpaces();
+    auto ch = scanner.peek();
+    if (ch == EOF) {
+      break;
+    }
+    if (ch == 'c') {
+      scanner.skipLine();
+      continue;
+    }
+    if (ch == 'p') {
+      scanner.get();
+      if (scanner.readWord() != "cnf") {
+        throw std::runtime_error("Only 'p cnf' DIMACS files are supported");
+      }
+      auto variable_count = scanner.readInt();
+      auto clause_count = scanner.readInt();
+      if (variable_count < 0 || clause_count < 0) {
+        throw std::runtime_error("Malformed DIMACS header");
+      }
+      result.variable_count = variable_count;
+      result.clauses.reserve(clause_count, clause_count * 3);
+      continue;
+    }
+    bool is_xor = ch == 'x';
+    if (is_xor) {
+      scanner.get();
+      xor_variables.clear();
+    }
+    bool rhs = true;
+    while (true) {
+      auto lit = scanner.readInt();
+      if (lit == 0) {
+        break;
+      }
+      auto variable = lit < 0 ? -lit : lit;
+      max_variable = std::max(max_variable, variable);
+      if (is_xor) {
+        rhs ^= lit < 0;
+        xor_variables.push_back(
+            static_cast<XorArena::StoredVariable>(variable));
+      } else {
+        result.clauses.push(static_cast<ClauseArena::StoredLiteral>(lit));
+      }
+    }
+    if (is_xor) {
+      result.xors.add(xor_variables, rhs);
+    } else {
+      result.clauses.commit();
+    }
+  }
+  result.variable_count = std::max(result.variable_count,
+                                   static_cast<std::size_t>(max_variable));
+  return result;
+}
+
+}  // namespace bonc::sat_modeller::dimacs
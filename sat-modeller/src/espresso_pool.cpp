@@ -0,0 +1,360 @@
+#include "espresso_pool.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "espresso_wrapper.h"
+
+namespace bonc::sat_modeller {
+
+namespace {
+
+// Messages both ways are a word count followed by that many 64-bit words.
+
+bool readAll(int fd, void* data, std::size_t size) {
+  auto ptr = static_cast<char*>(data);
+  while (size > 0) {
+    auto n = ::read(fd, ptr, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void* data, std::size_t size) {
+  auto ptr = static_cast<const char*>(data);
+  while (size > 0) {
+    // no SIGPIPE if the other side is gone
+    auto n = ::send(fd, ptr, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return false;
+    }
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool readWords(int fd, std::vector<std::uint64_t>& words) {
+  std::uint64_t size;
+  if (!readAll(fd, &size, sizeof(size))) {
+    return false;
+  }
+  words.resize(size);
+  return readAll(fd, words.data(), size * sizeof(std::uint64_t));
+}
+
+bool writeWords(int fd, const std::vector<std::uint64_t>& words) {
+  std::uint64_t size = words.size();
+  return writeAll(fd, &size, sizeof(size))
+      && writeAll(fd, words.data(), size * sizeof(std::uint64_t));
+}
+
+enum ReplyStatus : std::uint64_t { Done, Failed };
+
+/**
+ * The worker closed its socket, most likely killed by an espresso `fatal`.
+ */
+struct WorkerExited : std::runtime_error {
+  WorkerExited() : std::runtime_error("Espresso worker exited") {}
+};
+
+/**
+ * Request: width, minterms. Reply: `Done`, width, then the low and high bit
+ * masks of the entries of each clause; or `Failed` and the message, one
+ * character per word.
+ */
+[[noreturn]] void workerLoop(int fd) {
+  std::vector<std::uint64_t> request, reply;
+  while (readWords(fd, request)) {
+    reply.clear();
+    try {
+      EspressoCover cover{request.at(0), {request.begin() + 1, request.end()}};
+      auto table = espresso_cxx::minimize(cover);
+      reply.push_back(Done);
+      reply.push_back(cover.width);
+      for (auto& row : table) {
+        std::uint64_t low = 0, high = 0;
+        for (auto i = 0uz; i < row.size(); i++) {
+          low |= std::uint64_t(row[i] & 1) << i;
+          high |= std::uint64_t(row[i] >> 1) << i;
+        }
+        reply.push_back(low);
+        reply.push_back(high);
+      }
+    } catch (const std::exception& e) {
+      reply.assign({Failed});
+      reply.append_range(std::string_view{e.what()});
+    }
+    if (!writeWords(fd, reply)) {
+      break;
+    }
+  }
+  // skip the parent's atexit handlers and static destructors
+  ::_exit(0);
+}
+
+/**
+ * Pass `socket` over `fd`, or report a failure with a negative one.
+ */
+bool sendSocket(int fd, int socket) {
+  char status = socket >= 0;
+  iovec iov{&status, 1};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  if (socket >= 0) {
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    auto header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &socket, sizeof(int));
+  }
+  while (true) {
+    auto n = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    return n == 1;
+  }
+}
+
+/**
+ * @return The socket passed by `sendSocket`, or -1
+ */
+int receiveSocket(int fd) {
+  char status = 0;
+  iovec iov{&status, 1};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  ssize_t n;
+  do {
+    n = ::recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+  auto header = CMSG_FIRSTHDR(&message);
+  if (n != 1 || !status || !header || header->cmsg_level != SOL_SOCKET
+      || header->cmsg_type != SCM_RIGHTS) {
+    return -1;
+  }
+  int socket;
+  std::memcpy(&socket, CMSG_DATA(header), sizeof(int));
+  return socket;
+}
+
+/**
+ * Fork a worker for every byte read from `fd`, and pass back the socket to
+ * it. The pool itself may run threads by the time it needs a worker, and
+ * the child of a threaded process can only safely call async-signal-safe
+ * functions, which espresso is far from; this process stays single-threaded.
+ */
+[[noreturn]] void spawnerLoop(int fd) {
+  // exited workers are reaped by the kernel
+  ::signal(SIGCHLD, SIG_IGN);
+  char request;
+  while (readAll(fd, &request, 1)) {
+    int fds[2];
+    int socket = -1;
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0) {
+      auto pid = ::fork();
+      if (pid == 0) {
+        ::close(fd);
+        ::close(fds[0]);
+        workerLoop(fds[1]);
+      }
+      ::close(fds[1]);
+      if (pid > 0) {
+        socket = fds[0];
+      } else {
+        ::close(fds[0]);
+      }
+    }
+    auto sent = sendSocket(fd, socket);
+    if (socket >= 0) {
+      ::close(socket);
+    }
+    if (!sent) {
+      break;
+    }
+  }
+  // with SIGCHLD ignored, this returns once all workers have exited
+  while (::wait(nullptr) >= 0 || errno == EINTR) {
+  }
+  ::_exit(0);
+}
+
+/**
+ * @return A socket to a new worker forked by the spawner at `fd`, or -1
+ */
+int requestWorker(int fd) {
+  char request = 0;
+  if (!writeAll(fd, &request, 1)) {
+    return -1;
+  }
+  return receiveSocket(fd);
+}
+
+TableTemplate run(int fd, const EspressoCover& cover) {
+  std::vector<std::uint64_t> words{cover.width};
+  words.append_range(cover.minterms);
+  if (!writeWords(fd, words) || !readWords(fd, words) || words.empty()) {
+    throw WorkerExited{};
+  }
+  if (words[0] == Failed) {
+    std::string message;
+    for (auto i = 1uz; i < words.size(); i++) {
+      message.push_back(static_cast<char>(words[i]));
+    }
+    throw std::runtime_error(message);
+  }
+  auto width = words.at(1);
+  TableTemplate table;
+  std::vector<TableTemplate::Entry> clause(width);
+  for (auto i = 2uz; i + 1 < words.size(); i += 2) {
+    for (auto bit = 0uz; bit < width; bit++) {
+      clause[bit] = static_cast<TableTemplate::Entry>(
+          ((words[i] >> bit) & 1) | (((words[i + 1] >> bit) & 1) << 1));
+    }
+    table.addClause(clause);
+  }
+  return table;
+}
+
+}  // namespace
+
+bool EspressoPool::respawn(Worker& worker) {
+  ::close(worker.fd);
+  std::lock_guard lock{mutex};
+  worker.fd = requestWorker(spawner_fd);
+  return worker.fd >= 0 || --live == 0;
+}
+
+void EspressoPool::stopWorkers() {
+  for (auto& worker : workers) {
+    if (worker.fd >= 0) {
+      ::close(worker.fd);
+    }
+  }
+  ::close(spawner_fd);
+  ::waitpid(spawner, nullptr, 0);
+}
+
+EspressoPool::EspressoPool(std::size_t count) {
+  if (count == 0) {
+    return;
+  }
+  int fds[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    throw std::runtime_error("Failed to start espresso worker");
+  }
+  spawner = ::fork();
+  if (spawner < 0) {
+    ::close(fds[0]);
+    ::close(fds[1]);
+    throw std::runtime_error("Failed to start espresso worker");
+  }
+  if (spawner == 0) {
+    ::close(fds[0]);
+    spawnerLoop(fds[1]);
+  }
+  ::close(fds[1]);
+  spawner_fd = fds[0];
+  for (auto i = 0uz; i < count; i++) {
+    auto fd = requestWorker(spawner_fd);
+    if (fd < 0) {
+      // the destructor does not run if the constructor throws
+      stopWorkers();
+      throw std::runtime_error("Failed to start espresso worker");
+    }
+    workers.push_back({fd});
+  }
+  live = count;
+  for (auto& worker : workers) {
+    dispatchers.emplace_back([this, &worker] { dispatch(worker); });
+  }
+}
+
+EspressoPool::~EspressoPool() {
+  {
+    std::lock_guard lock{mutex};
+    stopping = true;
+  }
+  queued.notify_all();
+  dispatchers.clear();
+  if (spawner > 0) {
+    stopWorkers();
+  }
+}
+
+void EspressoPool::dispatch(Worker& worker) {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock lock{mutex};
+      queued.wait(lock, [&] { return stopping || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    try {
+      if (worker.fd < 0) {
+        job.promise.set_value(espresso_cxx::minimize(job.cover));
+      } else {
+        job.promise.set_value(run(worker.fd, job.cover));
+      }
+    } catch (const WorkerExited&) {
+      job.promise.set_exception(std::current_exception());
+      if (!respawn(worker)) {
+        return;
+      }
+    } catch (...) {
+      job.promise.set_exception(std::current_exception());
+    }
+  }
+}
+
+std::future<TableTemplate> EspressoPool::submit(EspressoCover cover) {
+  std::promise<TableTemplate> promise;
+  auto future = promise.get_future();
+  if (workers.empty()) {
+    try {
+      promise.set_value(espresso_cxx::minimize(cover));
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+    }
+    return future;
+  }
+  {
+    std::lock_guard lock{mutex};
+    jobs.push_back({std::move(cover), std::move(promise)});
+  }
+  queued.notify_one();
+  return future;
+}
+
+}  // namespace bonc::sat_modeller
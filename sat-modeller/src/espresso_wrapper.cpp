@@ -1,5 +1,7 @@
 #include "espresso_wrapper.h"
 
+#include <mutex>
+#include <utility>
 #include <stdexcept>
 
 #include "defer.hpp"
@@ -70,11 +72,16 @@ void setPos(bool pos) {
   ::pos = pos;
 }
 
-PPLA readPlaForEspresso(const std::string& input) {
+// forget the cube structure of the last PLA
+static void resetCube() {
   memset(&::cube, 0, sizeof(::cube));
   memset(&::temp_cube_save, 0, sizeof(::temp_cube_save));
   memset(&::cdata, 0, sizeof(::cdata));
   memset(&::temp_cdata_save, 0, sizeof(::temp_cdata_save));
+}
+
+PPLA readPlaForEspresso(const std::string& input) {
+  resetCube();
 
   auto fp = fmemopen(const_cast<char*>(input.c_str()), input.size(), "r");
   if (!fp) {
@@ -127,4 +134,49 @@ TableTemplate plaToTableTemplate(const PPLA& pla) {
   return table;
 }
 
+PPLA coverToPla(const EspressoCover& cover) {
+  resetCube();
+  // what `parse_pla` sets up for `.i <width>` and `.o 1`
+  ::cube.num_binary_vars = static_cast<int>(cover.width);
+  ::cube.num_vars = ::cube.num_binary_vars + 1;
+  ::cube.part_size = ALLOC(int, ::cube.num_vars);
+  ::cube.part_size[::cube.num_vars - 1] = 1;
+  ::cube_setup();
+
+  PPLA result(::new_PLA());
+  auto pla = static_cast<pPLA>(result.get());
+  pla->pla_type = FD_type;
+  pla->F = new_cover(static_cast<int>(cover.minterms.size()));
+  pla->D = new_cover(10);
+  pla->R = new_cover(10);
+  auto cf = ::cube.temp[0];
+  auto output = ::cube.first_part[::cube.num_vars - 1];
+  for (auto minterm : cover.minterms) {
+    set_clear(cf, ::cube.size);
+    for (int var = 0; var < ::cube.num_binary_vars; var++) {
+      // part 2 * var is the value 0, 2 * var + 1 the value 1
+      int part = 2 * var + static_cast<int>((minterm >> var) & 1);
+      set_insert(cf, part);
+    }
+    set_insert(cf, output);
+    pla->F = sf_addset(pla->F, cf);
+  }
+
+  // and what `read_pla` does next in PoS mode: the OFF-set, as the
+  // complement of the ON-set, becomes F
+  free_cover(pla->R);
+  pla->R = ::complement(::cube2list(pla->F, pla->D));
+  std::swap(pla->F, pla->R);
+  pla->phase = new_cube();
+  set_diff(pla->phase, ::cube.fullset, ::cube.mv_mask);
+  return result;
+}
+
+TableTemplate minimize(const EspressoCover& cover) {
+  static std::mutex mutex;
+  std::lock_guard lock{mutex};
+  auto pla = coverToPla(cover);
+  return plaToTableTemplate(pla);
+}
+
 }
\ No newline at end of file
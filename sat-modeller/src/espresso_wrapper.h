@@ -3,6 +3,7 @@
 #include <memory>
 #include <string>
 
+#include "espresso_pool.h"
 #include "table_template.h"
 
 namespace bonc::sat_modeller::espresso_cxx {
@@ -22,4 +23,16 @@ std::string plaToString(const PPLA& pla);
 
 TableTemplate plaToTableTemplate(const PPLA& pla);
 
+/**
+ * @brief The PLA `readPlaForEspresso` reads for `cover` in PoS mode, built
+ * from the minterms directly instead of parsing their text.
+ */
+PPLA coverToPla(const EspressoCover& cover);
+
+/**
+ * @brief Minimise `cover` as a product of sums. Calls from several threads
+ * take turns, as espresso is not reentrant.
+ */
+TableTemplate minimize(const EspressoCover& cover);
+
 }  // namespace espresso
\ No newline at end of file
@@ -4,66 +4,126 @@
 #include <bit>
 #include <cmath>
 #include <format>
-#include <unordered_set>
+#include <limits>
 #include <print>
+#include <stdexcept>
 
-#include "combinations.hpp"
+#include "dimacs.h"
 #include "espresso_wrapper.h"
 
 namespace bonc::sat_modeller {
 
-Variable SATModel::createVariable(const std::string& name) {
-  variables.push_back({name});
+std::uint32_t SATModel::internPrefix(std::string_view prefix) {
+  if (auto it = prefix_ids.find(prefix); it != prefix_ids.end()) {
+    return it->second;
+  }
+  auto id = static_cast<std::uint32_t>(name_prefixes.size());
+  name_prefixes.emplace_back(prefix);
+  prefix_ids.emplace(name_prefixes.back(), id);
+  return id;
+}
+
+Variable SATModel::createVariable(std::string_view name) {
+  variables.push_back({.prefix = internPrefix(name)});
   return Variable(variables.size() - 1);
 }
 
-std::vector<Variable> SATModel::createVariables(
-    std::size_t count, const std::string& name_prefix) {
+std::vector<Variable> SATModel::createVariables(std::size_t count,
+                                                std::string_view name_prefix) {
+  auto prefix = internPrefix(name_prefix);
   std::vector<Variable> vars;
+  vars.reserve(count);
   for (std::size_t i = 0; i < count; ++i) {
-    vars.push_back(createVariable(std::format("{}_{}", name_prefix, i)));
+    variables.push_back({prefix, static_cast<std::uint32_t>(i)});
+    vars.push_back(Variable(variables.size() - 1));
   }
   return vars;
 }
 
-void SATModel::addClause(const std::vector<Literal>& lits) {
-  clauses.push_back({lits});
+Variable SATModel::copyVariable(const SATModel& other, std::size_t index) {
+  auto detail = other.variables.at(index);
+  detail.prefix = internPrefix(other.name_prefixes[detail.prefix]);
+  variables.push_back(detail);
+  return Variable(variables.size() - 1);
 }
 
-TableTemplate SATModel::buildTableTemplate(const RawTable& table, SATModel::GetWeightFunction weight_fn) {
+std::string SATModel::getVariableName(std::size_t index) const {
+  auto detail = variables.at(index);
+  auto& prefix = name_prefixes[detail.prefix];
+  if (detail.index == VariableDetail::NO_INDEX) {
+    return prefix;
+  }
+  return std::format("{}_{}", prefix, detail.index);
+}
+
+std::size_t SATModel::nameMemoryUsage() const {
+  auto usage = variables.capacity() * sizeof(VariableDetail)
+             + name_prefixes.capacity() * sizeof(std::string);
+  for (auto& prefix : name_prefixes) {
+    // hash node and the string's heap buffer
+    usage += 2 * sizeof(void*) + sizeof(std::string) + sizeof(std::uint32_t)
+           + prefix.capacity();
+  }
+  return usage;
+}
+
+void SATModel::pushLiteral(Literal lit) {
+  using StoredLiteral = ClauseArena::StoredLiteral;
+  assert(std::abs(lit.getIndex()) <= std::numeric_limits<StoredLiteral>::max());
+  pending.push_back(static_cast<StoredLiteral>(lit.getIndex()));
+}
+
+void SATModel::commitClause() {
+  sink->addClause(pending);
+  pending.clear();
+  clause_count++;
+}
+
+void SATModel::addClause(std::span<const Literal> lits) {
+  for (auto lit : lits) {
+    pushLiteral(lit);
+  }
+  commitClause();
+}
+
+void SATModel::addClause(std::initializer_list<Literal> lits) {
+  addClause(std::span{lits.begin(), lits.size()});
+}
+
+EspressoCover SATModel::emptyTemplateCover(std::size_t input_width,
+                                           std::size_t output_width) {
+  EspressoCover cover{.width = input_width + 2 * output_width};
+  if (cover.width > std::numeric_limits<std::uint64_t>::digits) {
+    throw std::runtime_error("Table too wide for an espresso cover");
+  }
+  return cover;
+}
+
+EspressoCover SATModel::tableTemplateCover(const RawTable& table,
+                                           GetWeightFunction weight_fn) {
   assert(table.size() > 1 && table.at(0).size() > 1);
   auto input_width = std::bit_width(table.size() - 1);
   auto output_width = std::bit_width(table.at(0).size() - 1);
 
-  std::string espresso_input;
-  espresso_input +=
-      std::format(".i {}\n.o 1\n", input_width + 2 * output_width);
+  auto cover = emptyTemplateCover(input_width, output_width);
   for (auto i = 0uz; i < table.size(); i++) {
     const auto& row = table.at(i);
     for (auto j = 0uz; j < row.size(); j++) {
-      auto val = row.at(j);
-      if (val) {
-        // std::println("DEBUG: {} {} {}", i, j, val);
-        std::string input_bitvec = std::format("{:0{}b}", i, input_width);
-        std::ranges::reverse(input_bitvec);
-        std::string output_bitvec = std::format("{:0{}b}", j, output_width);
-        std::ranges::reverse(output_bitvec);
-        auto weight = weight_fn(val);
-        std::string weight_vec = std::format("{:0>{}}{:1>{}}", "",
-                                             output_width - weight, "", weight);
-        espresso_input +=
-            std::format("{}{}{} 1\n", input_bitvec, output_bitvec, weight_vec);
+      if (auto val = row.at(j)) {
+        cover.minterms.push_back(templateMinterm(input_width, output_width, i,
+                                                 j, weight_fn(val)));
       }
     }
   }
-  espresso_input += ".e\n";
-  // std::println("{}", espresso_input);
+  return cover;
+}
+
+TableTemplate SATModel::buildTableTemplate(const RawTable& table, SATModel::GetWeightFunction weight_fn) {
+  return buildTableTemplate(tableTemplateCover(table, std::move(weight_fn)));
+}
 
-  // run espresso
-  espresso_cxx::setPos(true);
-  auto pla = espresso_cxx::readPlaForEspresso(espresso_input);
-  auto table_template = espresso_cxx::plaToTableTemplate(pla);
-  return table_template;
+TableTemplate SATModel::buildTableTemplate(const EspressoCover& cover) {
+  return espresso_cxx::minimize(cover);
 }
 
 std::vector<Variable> SATModel::addWeightTableClauses(
@@ -77,7 +137,6 @@ std::vector<Variable> SATModel::addWeightTableClauses(
 
   auto weight_vars = createVariables(output_width, "w");
   for (const auto& row : table) {
-    auto clause = std::vector<Literal>();
     for (auto i = 0uz; i < row.size(); i++) {
       auto entry = row.at(i);
       auto var = i < input_width ? inputs.at(i)
@@ -85,74 +144,99 @@ std::vector<Variable> SATModel::addWeightTableClauses(
                    ? outputs.at(i - input_width)
                    : weight_vars.at(i - input_width - output_width);
       switch (entry) {
-        case TableTemplate::Entry::Positive: clause.push_back(var); break;
-        case TableTemplate::Entry::Negative: clause.push_back(-var); break;
+        case TableTemplate::Entry::Positive: pushLiteral(var); break;
+        case TableTemplate::Entry::Negative: pushLiteral(-var); break;
         case TableTemplate::Entry::Unknown: break;
         case TableTemplate::Entry::NotTaken: break;
       }
     }
-    addClause(clause);
+    commitClause();
   }
   return weight_vars;
 }
 
+void SATModel::expandXor(std::span<const Variable> operands, bool rhs) {
+  // forbid every assignment whose parity differs from rhs: one clause per
+  // subset of negated operands, enumerated as bit masks
+  assert(operands.size() < std::numeric_limits<std::size_t>::digits);
+  for (auto mask = 0uz; mask < (1uz << operands.size()); mask++) {
+    if (std::popcount(mask) % 2 == rhs) {
+      continue;
+    }
+    for (auto i = 0uz; i < operands.size(); i++) {
+      pushLiteral((mask >> i) & 1 ? -operands[i] : Literal(operands[i]));
+    }
+    commitClause();
+  }
+}
+
 void SATModel::addXorClause(const std::vector<Variable>& values,
                             Variable result) {
   std::vector<Variable> operands{values};
   operands.push_back(result);
-  for (auto i = 1uz; i < operands.size() + 1; i += 2) {
-    for (auto subset : combinations<std::unordered_set>(operands, i)) {
-      std::vector<Literal> clause;
-      for (auto operand : operands) {
-        if (subset.contains(operand)) {
-          clause.push_back(-operand);
-        } else {
-          clause.push_back(operand);
-        }
-      }
-      addClause(clause);
+  addXorConstraint(operands, false);
+}
+
+void SATModel::addXorConstraint(std::span<const Variable> operands,
+                                bool rhs) {
+  if (xor_encoding == XorEncoding::Native) {
+    for (auto operand : operands) {
+      pushLiteral(operand);
     }
+    sink->addXor(pending, rhs);
+    pending.clear();
+    xor_count++;
+    return;
   }
+  if (xor_cut_width == 0 || operands.size() <= xor_cut_width) {
+    expandXor(operands, rhs);
+    return;
+  }
+  // x_1 ^ ... ^ x_n = rhs becomes the chain t_1 = x_1 ^ ... ^ x_{w-1},
+  // t_2 = t_1 ^ x_w ^ ..., ..., t_m ^ ... ^ x_n = rhs
+  std::vector<Variable> chunk;
+  chunk.reserve(xor_cut_width);
+  auto remaining = operands;
+  while (chunk.size() + remaining.size() > xor_cut_width) {
+    auto take = xor_cut_width - 1 - chunk.size();
+    chunk.insert(chunk.end(), remaining.begin(), remaining.begin() + take);
+    remaining = remaining.subspan(take);
+    auto carry = createVariable("xor_cut");
+    chunk.push_back(carry);
+    expandXor(chunk, false);
+    chunk.assign(1, carry);
+  }
+  chunk.insert(chunk.end(), remaining.begin(), remaining.end());
+  expandXor(chunk, rhs);
 }
 
 void SATModel::addAndClause(const std::vector<Variable>& values,
                             Variable result) {
-  std::vector<Literal> clause;
   for (auto value : values) {
-    clause.push_back(value);
-    clause.push_back(-result);
-    addClause(clause);
-    clause.clear();
+    addClause({value, -result});
   }
   for (auto value : values) {
-    clause.push_back(-value);
+    pushLiteral(-value);
   }
-  clause.push_back(result);
-  addClause(clause);
+  pushLiteral(result);
+  commitClause();
 }
 
 void SATModel::addOrClause(const std::vector<Variable>& values,
                            Variable result) {
-  std::vector<Literal> clause;
   for (auto value : values) {
-    clause.push_back(-value);
-    clause.push_back(result);
-    addClause(clause);
-    clause.clear();
+    addClause({-value, result});
   }
   for (auto value : values) {
-    clause.push_back(value);
+    pushLiteral(value);
   }
-  clause.push_back(-result);
-  addClause(clause);
+  pushLiteral(-result);
+  commitClause();
 }
 
 void SATModel::addEquivalentClause(const std::vector<Variable>& values) {
-  std::vector<Variable> rotated_values;
-  rotated_values.reserve(values.size());
-  std::ranges::rotate_copy(values, values.begin() + 1, std::back_inserter(rotated_values));
   for (auto i = 0uz; i < values.size(); i++) {
-    addClause({-values.at(i), rotated_values.at(i)});
+    addClause({-values.at(i), values.at((i + 1) % values.size())});
   }
 }
 
@@ -182,6 +266,31 @@ void SATModel::addSequentialCounterLessEqualClause(std::vector<Variable> x,
   addClause({-x.at(n - 1), -s.at(n - 2).at(k - 1)});
 }
 
+std::vector<std::vector<Variable>> SATModel::addSequentialCounter(
+    std::span<const Variable> x, std::size_t k) {
+  assert(k >= 1);
+  std::vector<std::vector<Variable>> s;
+  s.reserve(x.size());
+  for (auto i = 0uz; i < x.size(); i++) {
+    s.push_back(createVariables(k, std::format("seq_cnt_r_{}", i)));
+    addClause({-x[i], s[i][0]});
+    if (i == 0) {
+      for (auto j = 1uz; j < k; j++) {
+        addClause({-s[0][j]});
+      }
+      continue;
+    }
+    for (auto j = 0uz; j < k; j++) {
+      addClause({-s[i - 1][j], s[i][j]});
+    }
+    for (auto j = 1uz; j < k; j++) {
+      addClause({-x[i], -s[i - 1][j - 1], s[i][j]});
+    }
+    addClause({-x[i], -s[i - 1][k - 1]});
+  }
+  return s;
+}
+
 void SATModel::printLiteral(std::ostream& os, Literal lit,
                             bool print_name) const {
   auto index = lit.getIndex();
@@ -189,7 +298,7 @@ void SATModel::printLiteral(std::ostream& os, Literal lit,
     os << "-";
   }
   auto var_index = std::abs(index);
-  auto name = variables.at(var_index).name;
+  auto name = getVariableName(var_index);
   if (!print_name || name.empty()) {
     os << var_index;
   } else {
@@ -198,9 +307,9 @@ void SATModel::printLiteral(std::ostream& os, Literal lit,
 }
 
 void SATModel::print(std::ostream& os, bool print_names) const {
-  for (const auto& clause : clauses) {
-    for (const auto& lit : clause.lits) {
-      printLiteral(os, lit, print_names);
+  for (auto clause : getClauses()) {
+    for (auto lit : clause) {
+      printLiteral(os, Literal(lit), print_names);
       os << " ";
     }
     os << "\n";
@@ -208,13 +317,21 @@ void SATModel::print(std::ostream& os, bool print_names) const {
 }
 
 void SATModel::printDIMACS(std::ostream& os) {
-  os << "p cnf " << variables.size() - 1 << " " << clauses.size() << "\n";
-  for (const auto& clause : clauses) {
-    for (const auto& lit : clause.lits) {
-      os << lit.getIndex() << " ";
-    }
-    os << "0\n";
+  assert(storesClauses());
+  std::string xor_lines;
+  auto xor_lines_count = dimacs::formatXors(xor_lines, getXors());
+  os << "p cnf " << variables.size() - 1 << " "
+     << clause_count + xor_lines_count << "\n";
+  const auto& stored = getClauses();
+  constexpr auto CLAUSES_PER_CHUNK = 1uz << 16;
+  std::string chunk;
+  for (auto first = 0uz; first < stored.size(); first += CLAUSES_PER_CHUNK) {
+    chunk.clear();
+    dimacs::formatClauses(chunk, stored, first,
+                          std::min(first + CLAUSES_PER_CHUNK, stored.size()));
+    os.write(chunk.data(), chunk.size());
   }
+  os.write(xor_lines.data(), xor_lines.size());
 }
 
 }  // namespace bonc::sat_modeller
@@ -0,0 +1,421 @@
+#include "simplifier.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <ranges>
+#include <utility>
+
+namespace bonc::sat_modeller {
+
+namespace {
+
+using StoredLiteral = ClauseArena::StoredLiteral;
+
+StoredLiteral variableOf(StoredLiteral lit) {
+  return std::abs(lit);
+}
+
+/**
+ * @brief Assignments and literal equivalences found so far.
+ *
+ * Equivalences form a union-find over variables where every variable points
+ * to a literal of its parent, so a class is rooted at one variable and its
+ * members equal the root or its negation. Only roots carry values.
+ */
+class Simplifier {
+private:
+  std::vector<StoredLiteral> parent;
+  std::vector<std::int8_t> value;
+  bool conflict{false};
+  bool changed{false};
+
+  std::vector<StoredLiteral> binaries;
+  std::vector<StoredLiteral> buffer;
+  std::vector<StoredLiteral> kept;
+
+public:
+  explicit Simplifier(std::size_t variable_count)
+      : parent(variable_count + 1), value(variable_count + 1, 0) {
+    for (auto var = 0uz; var <= variable_count; var++) {
+      parent[var] = static_cast<StoredLiteral>(var);
+    }
+  }
+
+  bool unsatisfiable() const {
+    return conflict;
+  }
+
+  /**
+   * @brief The literal on a class root which `lit` equals.
+   */
+  StoredLiteral find(StoredLiteral lit) {
+    auto root = lit;
+    while (parent[variableOf(root)] != variableOf(root)) {
+      auto next = parent[variableOf(root)];
+      root = root < 0 ? -next : next;
+    }
+    // path compression, each variable relinked to the root directly
+    auto var = variableOf(lit);
+    auto var_root = lit < 0 ? -root : root;
+    while (parent[var] != var) {
+      auto next = parent[var];
+      parent[var] = var_root;
+      var_root = next < 0 ? -var_root : var_root;
+      var = variableOf(next);
+    }
+    return root;
+  }
+
+  /**
+   * @brief 1 / -1 if `lit` is fixed to true / false, otherwise 0.
+   */
+  int valueOf(StoredLiteral lit) {
+    auto root = find(lit);
+    auto root_value = value[variableOf(root)];
+    return root < 0 ? -root_value : root_value;
+  }
+
+  void assign(StoredLiteral lit) {
+    auto root = find(lit);
+    auto& root_value = value[variableOf(root)];
+    std::int8_t expected = root < 0 ? -1 : 1;
+    if (root_value == -expected) {
+      conflict = true;
+    } else if (root_value == 0) {
+      root_value = expected;
+      changed = true;
+    }
+  }
+
+  /**
+   * @brief Record `lhs == rhs`; the class with the smaller root absorbs the
+   * other.
+   */
+  void unite(StoredLiteral lhs, StoredLiteral rhs) {
+    lhs = find(lhs);
+    rhs = find(rhs);
+    if (lhs == rhs) {
+      return;
+    }
+    if (lhs == -rhs) {
+      conflict = true;
+      return;
+    }
+    if (variableOf(lhs) > variableOf(rhs)) {
+      std::swap(lhs, rhs);
+    }
+    // root of rhs, as a literal on the root of lhs
+    auto image = rhs < 0 ? -lhs : lhs;
+    auto var = variableOf(rhs);
+    auto old_value = value[var];
+    parent[var] = image;
+    value[var] = 0;
+    changed = true;
+    if (old_value != 0) {
+      assign(old_value > 0 ? image : -image);
+    }
+  }
+
+  /**
+   * @brief Rewrite clauses under the current assignment and equivalences:
+   * satisfied and tautological clauses are dropped, false literals removed,
+   * units assigned. Binary clauses are kept aside for `findEquivalences`.
+   *
+   * @return Whether anything was learnt.
+   */
+  bool propagateClauses(const ClauseArena& clauses, ClauseArena& out) {
+    changed = false;
+    binaries.clear();
+    out.clear();
+    for (auto clause : clauses) {
+      buffer.clear();
+      auto satisfied = false;
+      for (auto lit : clause) {
+        auto lit_value = valueOf(lit);
+        if (lit_value > 0) {
+          satisfied = true;
+          break;
+        }
+        if (lit_value == 0) {
+          buffer.push_back(find(lit));
+        }
+      }
+      if (satisfied) {
+        continue;
+      }
+      std::ranges::sort(buffer, {}, [](auto lit) {
+        return std::pair(variableOf(lit), lit);
+      });
+      auto [first, last] = std::ranges::unique(buffer);
+      buffer.erase(first, last);
+      if (std::ranges::adjacent_find(buffer, {}, variableOf) != buffer.end()) {
+        continue;
+      }
+      if (buffer.empty()) {
+        conflict = true;
+        return true;
+      }
+      if (buffer.size() == 1) {
+        assign(buffer.front());
+        continue;
+      }
+      if (buffer.size() == 2) {
+        binaries.append_range(buffer);
+      }
+      out.add(buffer);
+    }
+    return changed || conflict;
+  }
+
+  /**
+   * @brief Rewrite XOR constraints likewise; a 2-variable XOR becomes an
+   * equivalence.
+   */
+  bool propagateXors(const XorArena& xors, XorArena& out) {
+    changed = false;
+    out.clear();
+    for (auto i = 0uz; i < xors.size(); i++) {
+      auto [variables, rhs] = xors[i];
+      buffer.clear();
+      for (auto var : variables) {
+        auto lit = find(var);
+        auto lit_value = valueOf(lit);
+        if (lit_value != 0) {
+          rhs ^= lit_value > 0;
+          continue;
+        }
+        rhs ^= lit < 0;
+        buffer.push_back(variableOf(lit));
+      }
+      // x ^ x = 0
+      std::ranges::sort(buffer);
+      kept.clear();
+      for (auto j = 0uz; j < buffer.size(); j++) {
+        if (j + 1 < buffer.size() && buffer[j] == buffer[j + 1]) {
+          j++;
+        } else {
+          kept.push_back(buffer[j]);
+        }
+      }
+      if (kept.empty()) {
+        if (rhs) {
+          conflict = true;
+          return true;
+        }
+      } else if (kept.size() == 1) {
+        assign(rhs ? kept[0] : -kept[0]);
+      } else if (kept.size() == 2) {
+        unite(kept[0], rhs ? -kept[1] : kept[1]);
+      } else {
+        out.add(kept, rhs);
+      }
+    }
+    return changed || conflict;
+  }
+
+  /**
+   * @brief Unite the literals of every strongly connected component of the
+   * implication graph of the binary clauses from the last
+   * `propagateClauses`, found by an iterative Tarjan's algorithm.
+   */
+  bool findEquivalences() {
+    changed = false;
+    auto node = [](StoredLiteral lit) {
+      return 2 * static_cast<std::size_t>(variableOf(lit)) + (lit < 0);
+    };
+    auto literal = [](std::size_t node) {
+      auto var = static_cast<StoredLiteral>(node / 2);
+      return node % 2 ? -var : var;
+    };
+    auto node_count = 2 * parent.size();
+    // (a | b) gives -a -> b and -b -> a, in CSR form
+    std::vector<std::size_t> offsets(node_count + 1, 0);
+    for (auto i = 0uz; i < binaries.size(); i += 2) {
+      offsets[node(-binaries[i]) + 1]++;
+      offsets[node(-binaries[i + 1]) + 1]++;
+    }
+    for (auto i = 0uz; i < node_count; i++) {
+      offsets[i + 1] += offsets[i];
+    }
+    std::vector<std::size_t> edges(binaries.size());
+    auto fill = offsets;
+    for (auto i = 0uz; i < binaries.size(); i += 2) {
+      edges[fill[node(-binaries[i])]++] = node(binaries[i + 1]);
+      edges[fill[node(-binaries[i + 1])]++] = node(binaries[i]);
+    }
+
+    constexpr auto UNVISITED = std::numeric_limits<std::size_t>::max();
+    std::vector<std::size_t> index(node_count, UNVISITED);
+    std::vector<std::size_t> low(node_count, 0);
+    std::vector<bool> on_stack(node_count, false);
+    std::vector<std::size_t> stack;
+    // (node, next edge)
+    std::vector<std::pair<std::size_t, std::size_t>> calls;
+    auto next_index = 0uz;
+    for (auto start = 0uz; start < node_count; start++) {
+      if (index[start] != UNVISITED || offsets[start] == offsets[start + 1]) {
+        continue;
+      }
+      calls.emplace_back(start, offsets[start]);
+      index[start] = low[start] = next_index++;
+      stack.push_back(start);
+      on_stack[start] = true;
+      while (!calls.empty()) {
+        auto& [current, edge] = calls.back();
+        if (edge < offsets[current + 1]) {
+          auto next = edges[edge++];
+          if (index[next] == UNVISITED) {
+            index[next] = low[next] = next_index++;
+            stack.push_back(next);
+            on_stack[next] = true;
+            calls.emplace_back(next, offsets[next]);
+          } else if (on_stack[next]) {
+            low[current] = std::min(low[current], index[next]);
+          }
+          continue;
+        }
+        auto finished = current;
+        calls.pop_back();
+        if (!calls.empty()) {
+          auto caller = calls.back().first;
+          low[caller] = std::min(low[caller], low[finished]);
+        }
+        if (low[finished] != index[finished]) {
+          continue;
+        }
+        auto representative = literal(finished);
+        while (true) {
+          auto member = stack.back();
+          stack.pop_back();
+          on_stack[member] = false;
+          unite(representative, literal(member));
+          if (member == finished) {
+            break;
+          }
+        }
+      }
+    }
+    return changed || conflict;
+  }
+};
+
+}  // namespace
+
+std::size_t SimplifiedCNF::fixedSize() const {
+  return std::ranges::count_if(mapping, [](auto image) {
+    return image == FIXED_TRUE || image == -FIXED_TRUE;
+  });
+}
+
+std::size_t SimplifiedCNF::equivalentSize() const {
+  // members of a class other than the first one mapped to its literal
+  std::vector<bool> seen(variable_count + 1, false);
+  auto count = 0uz;
+  for (auto image : mapping | std::views::drop(1)) {
+    if (image == 0 || image == FIXED_TRUE || image == -FIXED_TRUE) {
+      continue;
+    }
+    auto var = variableOf(image);
+    if (seen[var]) {
+      count++;
+    }
+    seen[var] = true;
+  }
+  return count;
+}
+
+std::size_t SimplifiedCNF::freeSize() const {
+  return std::ranges::count(mapping | std::views::drop(1), 0);
+}
+
+SimplifiedCNF simplify(const ClauseArena& clauses, const XorArena& xors,
+                       std::size_t variable_count) {
+  Simplifier simplifier(variable_count);
+  SimplifiedCNF result;
+  ClauseArena current_clauses = clauses;
+  XorArena current_xors = xors;
+  ClauseArena next_clauses;
+  XorArena next_xors;
+  // until a whole round learns nothing, so the output is fully rewritten
+  while (!simplifier.unsatisfiable()) {
+    auto learnt = simplifier.propagateXors(current_xors, next_xors);
+    learnt |= simplifier.propagateClauses(current_clauses, next_clauses);
+    std::swap(current_clauses, next_clauses);
+    std::swap(current_xors, next_xors);
+    if (simplifier.unsatisfiable()) {
+      break;
+    }
+    learnt |= simplifier.findEquivalences();
+    if (!learnt) {
+      break;
+    }
+  }
+
+  result.mapping.assign(variable_count + 1, 0);
+  if (simplifier.unsatisfiable()) {
+    result.unsatisfiable = true;
+    result.clauses.commit();
+    return result;
+  }
+
+  // compact the variables still occurring, in their original order
+  std::vector<StoredLiteral> renumber(variable_count + 1, 0);
+  for (auto clause : current_clauses) {
+    for (auto lit : clause) {
+      renumber[variableOf(lit)] = 1;
+    }
+  }
+  for (auto i = 0uz; i < current_xors.size(); i++) {
+    for (auto var : current_xors[i].variables) {
+      renumber[var] = 1;
+    }
+  }
+  // the root of an equivalence class stays even if it no longer occurs, or
+  // the members would come back unrelated
+  for (auto var = 1uz; var <= variable_count; var++) {
+    auto lit = static_cast<StoredLiteral>(var);
+    if (simplifier.valueOf(lit) == 0) {
+      auto root = simplifier.find(lit);
+      if (root != lit) {
+        renumber[variableOf(root)] = 1;
+      }
+    }
+  }
+  for (auto var = 1uz; var <= variable_count; var++) {
+    if (renumber[var]) {
+      renumber[var] = static_cast<StoredLiteral>(++result.variable_count);
+    }
+  }
+  auto rename = [&](StoredLiteral lit) {
+    auto var = renumber[variableOf(lit)];
+    return lit < 0 ? -var : var;
+  };
+
+  result.clauses.reserve(current_clauses.size(),
+                         current_clauses.literalSize());
+  for (auto clause : current_clauses) {
+    for (auto lit : clause) {
+      result.clauses.push(rename(lit));
+    }
+    result.clauses.commit();
+  }
+  std::vector<StoredLiteral> renamed;
+  for (auto i = 0uz; i < current_xors.size(); i++) {
+    auto [variables, rhs] = current_xors[i];
+    renamed.assign_range(variables | std::views::transform(rename));
+    result.xors.add(renamed, rhs);
+  }
+
+  for (auto var = 1uz; var <= variable_count; var++) {
+    auto lit = static_cast<StoredLiteral>(var);
+    if (auto fixed = simplifier.valueOf(lit)) {
+      result.mapping[var] = fixed > 0 ? SimplifiedCNF::FIXED_TRUE
+                                      : -SimplifiedCNF::FIXED_TRUE;
+    } else {
+      result.mapping[var] = rename(simplifier.find(lit));
+    }
+  }
+  return result;
+}
+
+}  // namespace bonc::sat_modeller